@@ -0,0 +1,607 @@
+#define _GNU_SOURCE  // fallocate
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "archive.h"
+#include "seedlink.h"
+
+// 单调时钟毫秒数
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// FNV-1a 哈希
+static uint64_t path_hash(const char* path) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const char* p = path; *p; p++) {
+        hash ^= (unsigned char)*p;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash ^ (hash >> 33);
+}
+
+int archive_parse_layout(const char* name) {
+    if (strcasecmp(name, "flat") == 0) return ARCHIVE_LAYOUT_FLAT;
+    if (strcasecmp(name, "sds") == 0) return ARCHIVE_LAYOUT_SDS;
+    return -1;
+}
+
+ArchiveWriter* archive_create(const char* root, ArchiveLayout layout, int max_open, int idle_timeout_ms) {
+    ArchiveWriter* writer = (ArchiveWriter*)calloc(1, sizeof(ArchiveWriter));
+    if (!writer) return NULL;
+    
+    // 桶数取fd预算向上取整为2的幂，不少于打开文件数的两倍
+    size_t buckets = 16;
+    while (buckets < (size_t)max_open) buckets <<= 1;
+    writer->buckets = (ArchiveFile**)calloc(buckets, sizeof(ArchiveFile*));
+    if (!writer->buckets) {
+        free(writer);
+        return NULL;
+    }
+    
+    snprintf(writer->root, sizeof(writer->root), "%s", root);
+    writer->layout = layout;
+    writer->bucket_mask = buckets - 1;
+    writer->max_open = max_open > 2 ? max_open : 2;
+    writer->idle_timeout_ms = idle_timeout_ms;
+    return writer;
+}
+
+static void lru_unlink(ArchiveWriter* writer, ArchiveFile* file) {
+    if (file->lru_prev) file->lru_prev->lru_next = file->lru_next;
+    else writer->lru_head = file->lru_next;
+    if (file->lru_next) file->lru_next->lru_prev = file->lru_prev;
+    else writer->lru_tail = file->lru_prev;
+    file->lru_prev = file->lru_next = NULL;
+}
+
+static void lru_push_front(ArchiveWriter* writer, ArchiveFile* file) {
+    file->lru_prev = NULL;
+    file->lru_next = writer->lru_head;
+    if (writer->lru_head) writer->lru_head->lru_prev = file;
+    writer->lru_head = file;
+    if (!writer->lru_tail) writer->lru_tail = file;
+}
+
+// 释放文件末尾之后预分配但未使用的空间：截断到当前大小会释放文件末尾之后的块
+// （打洞不处理文件末尾之后的范围）
+static void release_preallocated(ArchiveFile* file) {
+    if (file->allocated <= file->offset) return;
+    if (ftruncate(file->fd, file->offset) < 0) {
+        seedlink_log(LOG_WARN, "无法释放预分配的空间 %s: %s", file->path, strerror(errno));
+    }
+    file->allocated = file->offset;
+}
+
+// 关闭文件并从缓存中移除，有未完成的异步写入时先等待全部完成；
+// 启用持久化时关闭前同步，避免关闭后漏掉这个文件
+static void close_file(ArchiveWriter* writer, ArchiveFile* file) {
+    if (file->inflight > 0) archive_drain(writer);
+    release_preallocated(file);
+    if (file->dirty && writer->sync_mode != ARCHIVE_SYNC_NONE) {
+        if (fdatasync(file->fd) < 0) {
+            seedlink_log(LOG_ERROR, "同步文件失败 %s: %s", file->path, strerror(errno));
+        }
+        writer->syncs++;
+    }
+    
+    ArchiveFile** link = &writer->buckets[file->hash & writer->bucket_mask];
+    while (*link != file) link = &(*link)->hash_next;
+    *link = file->hash_next;
+    lru_unlink(writer, file);
+    
+    archive_index_close(&file->index);
+    close(file->fd);
+    writer->open_fds -= file->fds;
+    free(file);
+    writer->open_count--;
+}
+
+// 记录所属的存档文件路径
+void archive_format_path(const ArchiveWriter* writer, const MiniSeedInfo* info, char* path, size_t size) {
+    if (writer->layout == ARCHIVE_LAYOUT_SDS) {
+        snprintf(path, size, "%s/%04d/%s/%s/%s.D/%s.%s.%s.%s.D.%04d.%03d", writer->root,
+                 info->year, info->network, info->station, info->channel,
+                 info->network, info->station, info->location, info->channel,
+                 info->year, info->day);
+    } else {
+        char name[256];
+        format_mseed_filename(info, name, sizeof(name));
+        snprintf(path, size, "%s/%s", writer->root, name);
+    }
+}
+
+// 同步path所在的目录，使其中新建的目录项在断电后仍然存在
+static void sync_parent_dir(const char* path) {
+    char dir[ARCHIVE_PATH_SIZE];
+    snprintf(dir, sizeof(dir), "%s", path);
+    char* slash = strrchr(dir, '/');
+    if (slash == dir) slash[1] = '\0';
+    else if (slash) *slash = '\0';
+    else snprintf(dir, sizeof(dir), ".");
+    
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0 || fsync(fd) < 0) {
+        seedlink_log(LOG_ERROR, "同步目录失败 %s: %s", dir, strerror(errno));
+    }
+    if (fd >= 0) close(fd);
+}
+
+// 逐级创建文件所在的目录；durable时每新建一级目录就同步它的上级目录
+static int make_parent_dirs(const char* path, int durable) {
+    char dir[ARCHIVE_PATH_SIZE];
+    snprintf(dir, sizeof(dir), "%s", path);
+    
+    for (char* p = dir + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = '\0';
+        if (mkdir(dir, 0755) == 0) {
+            if (durable) sync_parent_dir(dir);
+        } else if (errno != EEXIST) {
+            seedlink_log(LOG_ERROR, "无法创建目录 %s: %s", dir, strerror(errno));
+            return -1;
+        }
+        *p = '/';
+    }
+    return 0;
+}
+
+// 某通道开始写新一天的文件时，关闭该通道之前日期的文件
+static void close_previous_days(ArchiveWriter* writer, uint64_t channel, int day) {
+    ArchiveFile* file = writer->lru_head;
+    while (file) {
+        ArchiveFile* next = file->lru_next;
+        if (file->channel == channel && file->day < day) {
+            close_file(writer, file);
+            writer->rotations++;
+        }
+        file = next;
+    }
+}
+
+// 查找已打开的文件，没有时打开并加入缓存；超出fd预算时先关闭最久未使用的文件
+static ArchiveFile* get_file(ArchiveWriter* writer, const char* path, const MiniSeedInfo* info) {
+    uint64_t hash = path_hash(path);
+    for (ArchiveFile* file = writer->buckets[hash & writer->bucket_mask]; file; file = file->hash_next) {
+        if (file->hash == hash && strcmp(file->path, path) == 0) {
+            if (writer->lru_head != file) {
+                lru_unlink(writer, file);
+                lru_push_front(writer, file);
+            }
+            return file;
+        }
+    }
+    
+    uint64_t channel = miniseed_nslc_hash(info);
+    int day = info->year * 1000 + info->day;
+    if (writer->layout == ARCHIVE_LAYOUT_SDS) {
+        close_previous_days(writer, channel, day);
+    }
+    
+    // 新文件连同索引需要两个fd
+    while (writer->open_fds + 2 > writer->max_open && writer->lru_tail) {
+        close_file(writer, writer->lru_tail);
+        writer->evictions++;
+    }
+    
+    ArchiveFile* file = (ArchiveFile*)calloc(1, sizeof(ArchiveFile));
+    if (!file) return NULL;
+    
+    // 先不带O_CREAT打开，以便知道文件是否为新建
+    int durable = writer->sync_mode != ARCHIVE_SYNC_NONE;
+    int created = 0;
+    file->fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (file->fd < 0 && errno == ENOENT) {
+        created = 1;
+        file->fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        if (file->fd < 0 && errno == ENOENT && make_parent_dirs(path, durable) == 0) {
+            file->fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        }
+    }
+    if (file->fd < 0) {
+        seedlink_log(LOG_ERROR, "无法打开文件 %s: %s", path, strerror(errno));
+        free(file);
+        return NULL;
+    }
+    
+    // 从文件末尾继续追加
+    struct stat st;
+    file->offset = fstat(file->fd, &st) == 0 ? st.st_size : 0;
+    archive_index_open(&file->index, path, file->offset);
+    
+    // 新文件（及其索引）的目录项要先落盘，之后对文件的fdatasync才能保证数据可以找到
+    if (created && durable) sync_parent_dir(path);
+    snprintf(file->path, sizeof(file->path), "%s", path);
+    file->hash = hash;
+    file->channel = channel;
+    file->day = day;
+    file->hash_next = writer->buckets[hash & writer->bucket_mask];
+    writer->buckets[hash & writer->bucket_mask] = file;
+    lru_push_front(writer, file);
+    file->fds = file->index.fd >= 0 ? 2 : 1;
+    writer->open_fds += file->fds;
+    writer->open_count++;
+    writer->opens++;
+    return file;
+}
+
+// 同步写入，用于io_uring短写时补写剩余部分，以及写入失败时重试
+static int write_at(int fd, const unsigned char* data, size_t length, off_t offset) {
+    while (length > 0) {
+        ssize_t n = pwrite(fd, data, length, offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += n;
+        length -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+// 处理一个io_uring完成事件
+static void handle_completion(const struct io_uring_cqe* cqe, void* user) {
+    ArchiveWriter* writer = (ArchiveWriter*)user;
+    if (cqe->user_data == ARCHIVE_SYNC_TAG) {
+        if (cqe->res < 0) seedlink_log(LOG_ERROR, "同步文件失败: %s", strerror(-cqe->res));
+        writer->sync_inflight--;
+        return;
+    }
+    
+    ArchiveRequest* req = &writer->requests[cqe->user_data];
+    
+    // 偏移和索引条目在提交时已经登记，失败的写入必须补上，否则文件中会留下空洞；
+    // 用pwrite同步重试一次
+    if (cqe->res < 0) {
+        seedlink_log(LOG_WARN, "io_uring写入失败 %s: %s，改用pwrite重试",
+                     req->file->path, strerror(-cqe->res));
+        if (write_at(req->file->fd, req->data, req->length, req->offset) < 0) {
+            seedlink_log(LOG_ERROR, "写入miniSEED数据失败 %s: %s", req->file->path, strerror(errno));
+        }
+    } else if ((size_t)cqe->res < req->length &&
+               write_at(req->file->fd, req->data + cqe->res, req->length - cqe->res,
+                        req->offset + cqe->res) < 0) {
+        seedlink_log(LOG_ERROR, "写入miniSEED数据失败 %s: %s", req->file->path, strerror(errno));
+    }
+    
+    req->file->inflight--;
+    if (req->buffer >= 0) writer->buffer_inflight[req->buffer]--;
+    writer->inflight--;
+    req->next_free = writer->free_request;
+    writer->free_request = (int)(req - writer->requests);
+}
+
+// 数据所在的缓冲区序号
+static int find_buffer(const ArchiveWriter* writer, const unsigned char* data, size_t length) {
+    for (int i = 0; i < writer->buffer_count; i++) {
+        const unsigned char* base = (const unsigned char*)writer->buffers[i].iov_base;
+        if (data >= base && data + length <= base + writer->buffers[i].iov_len) return i;
+    }
+    return -1;
+}
+
+// 填写一个写入的SQE，暂不提交；请求表用完时先提交并等待一个完成事件
+static int queue_uring_write(ArchiveWriter* writer, ArchiveFile* file, const unsigned char* data, size_t length) {
+    while (writer->free_request < 0) {
+        if (uring_submit(writer->ring, 1) < 0) {
+            seedlink_log(LOG_ERROR, "io_uring提交失败: %s", strerror(errno));
+            return -1;
+        }
+        writer->submits++;
+        uring_reap(writer->ring, handle_completion, writer);
+    }
+    
+    struct io_uring_sqe* sqe = uring_get_sqe(writer->ring);
+    if (!sqe) {
+        uring_submit(writer->ring, 0);
+        writer->submits++;
+        sqe = uring_get_sqe(writer->ring);
+        if (!sqe) return -1;
+    }
+    
+    int index = writer->free_request;
+    ArchiveRequest* req = &writer->requests[index];
+    writer->free_request = req->next_free;
+    req->file = file;
+    req->data = data;
+    req->length = length;
+    req->offset = file->offset;
+    req->buffer = find_buffer(writer, data, length);
+    
+    int fixed = req->buffer >= 0 && writer->buffers_registered;
+    sqe->opcode = fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+    sqe->fd = file->fd;
+    sqe->addr = (uint64_t)(uintptr_t)data;
+    sqe->len = (uint32_t)length;
+    sqe->off = (uint64_t)file->offset;
+    sqe->buf_index = fixed ? (uint16_t)req->buffer : 0;
+    sqe->user_data = (uint64_t)index;
+    
+    file->offset += length;
+    file->inflight++;
+    file->dirty = 1;
+    writer->unsynced_records++;
+    if (req->buffer >= 0) writer->buffer_inflight[req->buffer]++;
+    writer->inflight++;
+    file->last_write_ms = now_ms();
+    writer->writes++;
+    return 0;
+}
+
+// 启用io_uring后端，内核不支持时返回-1，继续使用pwrite
+int archive_enable_uring(ArchiveWriter* writer, unsigned entries) {
+    URing* ring = (URing*)malloc(sizeof(URing));
+    ArchiveRequest* requests = (ArchiveRequest*)calloc(entries, sizeof(ArchiveRequest));
+    if (!ring || !requests || uring_init(ring, entries) < 0) {
+        seedlink_log(LOG_WARN, "无法启用io_uring (%s)，使用pwrite写入", strerror(errno));
+        free(ring);
+        free(requests);
+        return -1;
+    }
+    
+    // IORING_OP_WRITE需要5.6以上的内核，旧内核上io_uring_setup可能成功但写入全部失败
+    if (!uring_supports_op(ring, IORING_OP_WRITE)) {
+        seedlink_log(LOG_WARN, "内核的io_uring不支持IORING_OP_WRITE，使用pwrite写入");
+        uring_exit(ring);
+        free(ring);
+        free(requests);
+        return -1;
+    }
+    writer->write_fixed_supported = uring_supports_op(ring, IORING_OP_WRITE_FIXED);
+    
+    // 请求表大小与实际的队列深度一致，进行中的写入不会超过完成队列的容量
+    if (ring->entries < entries) entries = ring->entries;
+    for (unsigned i = 0; i < entries; i++) {
+        requests[i].next_free = i + 1 < entries ? (int)i + 1 : -1;
+    }
+    writer->ring = ring;
+    writer->requests = requests;
+    writer->free_request = 0;
+    return 0;
+}
+
+// 登记调用者轮流使用的缓冲区，用于archive_wait_buffer，并尝试注册为固定缓冲区；
+// 注册失败时仍可写入，只是不使用WRITE_FIXED
+int archive_register_buffers(ArchiveWriter* writer, const struct iovec* buffers, int count) {
+    if (!writer->ring || count > ARCHIVE_MAX_BUFFERS) return -1;
+    memcpy(writer->buffers, buffers, count * sizeof(struct iovec));
+    writer->buffer_count = count;
+    
+    if (!writer->write_fixed_supported) return -1;
+    if (uring_register_buffers(writer->ring, buffers, count) < 0) {
+        seedlink_log(LOG_WARN, "注册io_uring固定缓冲区失败: %s", strerror(errno));
+        return -1;
+    }
+    writer->buffers_registered = 1;
+    return 0;
+}
+
+// 一次提交所有已填写的写入，并回收已完成的事件
+int archive_submit(ArchiveWriter* writer) {
+    if (!writer->ring) return 0;
+    if (uring_submit(writer->ring, 0) < 0) {
+        seedlink_log(LOG_ERROR, "io_uring提交失败: %s", strerror(errno));
+        return -1;
+    }
+    writer->submits++;
+    uring_reap(writer->ring, handle_completion, writer);
+    return 0;
+}
+
+// 等待使用某个固定缓冲区的写入全部完成，之后该缓冲区可以重新使用
+void archive_wait_buffer(ArchiveWriter* writer, int buffer) {
+    while (writer->ring && writer->buffer_inflight[buffer] > 0) {
+        if (uring_submit(writer->ring, 1) < 0 && errno != EBUSY) break;
+        writer->submits++;
+        uring_reap(writer->ring, handle_completion, writer);
+    }
+}
+
+// 等待所有写入完成
+void archive_drain(ArchiveWriter* writer) {
+    while (writer->ring && writer->inflight > 0) {
+        if (uring_submit(writer->ring, 1) < 0 && errno != EBUSY) break;
+        writer->submits++;
+        uring_reap(writer->ring, handle_completion, writer);
+    }
+}
+
+void archive_set_preallocate(ArchiveWriter* writer, int enable) {
+    writer->preallocate = enable;
+}
+
+// 估计通道一天的数据量：每秒的记录数乘以记录长度，按1 MiB向上对齐；
+// 没有采样率的记录（日志等）按1 MiB
+static off_t estimate_day_size(const MiniSeedInfo* info, size_t length) {
+    off_t size = ARCHIVE_PREALLOC_ALIGN;
+    if (info->sample_rate > 0 && info->num_samples > 0) {
+        double records = info->sample_rate * 86400.0 / info->num_samples;
+        double bytes = records * length;
+        size = bytes >= ARCHIVE_PREALLOC_MAX ? ARCHIVE_PREALLOC_MAX : (off_t)bytes;
+    }
+    return (size + ARCHIVE_PREALLOC_ALIGN - 1) / ARCHIVE_PREALLOC_ALIGN * ARCHIVE_PREALLOC_ALIGN;
+}
+
+// 写入超出已分配的区域时再预分配一天的数据量，文件大小不变；
+// 文件系统不支持时关闭预分配，空间不足等错误只记录日志，继续写入
+static void preallocate(ArchiveWriter* writer, ArchiveFile* file, const MiniSeedInfo* info, size_t length) {
+    off_t end = file->offset + (off_t)length;
+    if (end <= file->allocated) return;
+    
+    off_t target = end + estimate_day_size(info, length);
+    target -= target % ARCHIVE_PREALLOC_ALIGN;
+    if (target < end) target = end;
+    off_t start = file->allocated > file->offset ? file->allocated : file->offset;
+    if (fallocate(file->fd, FALLOC_FL_KEEP_SIZE, start, target - start) < 0) {
+        if (errno == EOPNOTSUPP || errno == ENOSYS) {
+            seedlink_log(LOG_WARN, "文件系统不支持预分配，已关闭预分配: %s", file->path);
+            writer->preallocate = 0;
+        } else {
+            // 空间不足等错误不在每次写入时重试，写到target之前不再预分配
+            seedlink_log(LOG_WARN, "预分配失败 %s: %s", file->path, strerror(errno));
+            file->allocated = target;
+        }
+        return;
+    }
+    file->allocated = target;
+    writer->preallocations++;
+}
+
+// 把一条记录追加到所属通道的文件
+int archive_write(ArchiveWriter* writer, const MiniSeedInfo* info, const unsigned char* data, size_t length) {
+    char path[ARCHIVE_PATH_SIZE];
+    archive_format_path(writer, info, path, sizeof(path));
+    
+    ArchiveFile* file = get_file(writer, path, info);
+    if (!file) return -1;
+    
+    if (writer->preallocate) preallocate(writer, file, info, length);
+    
+    off_t offset = file->offset;
+    if (writer->ring) {
+        if (queue_uring_write(writer, file, data, length) < 0) return -1;
+        archive_index_add(&file->index, offset, info, length);
+        return 0;
+    }
+    
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = pwrite(file->fd, data + done, length - done, file->offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            seedlink_log(LOG_ERROR, "写入miniSEED数据失败 %s: %s", path, strerror(errno));
+            close_file(writer, file);
+            return -1;
+        }
+        done += n;
+        file->offset += n;
+    }
+    
+    archive_index_add(&file->index, offset, info, length);
+    file->dirty = 1;
+    writer->unsynced_records++;
+    file->last_write_ms = now_ms();
+    writer->writes++;
+    return 0;
+}
+
+// 写出各文件缓存的索引条目；有新条目的文件都在最近使用表的前端，遇到没有新条目的文件即可停止
+void archive_flush_index(ArchiveWriter* writer) {
+    for (ArchiveFile* file = writer->lru_head;
+         file && (file->index.pending > 0 || file->index.fd < 0); file = file->lru_next) {
+        archive_index_flush(&file->index);
+    }
+}
+
+// 解析持久化策略：none、close、interval:毫秒数、records:记录数
+int archive_parse_sync(const char* spec, ArchiveSyncMode* mode, int* value) {
+    const char* colon = strchr(spec, ':');
+    size_t len = colon ? (size_t)(colon - spec) : strlen(spec);
+    *value = colon ? atoi(colon + 1) : 0;
+    
+    if (len == 4 && strncasecmp(spec, "none", len) == 0) {
+        *mode = ARCHIVE_SYNC_NONE;
+    } else if (len == 5 && strncasecmp(spec, "close", len) == 0) {
+        *mode = ARCHIVE_SYNC_CLOSE;
+    } else if (len == 8 && strncasecmp(spec, "interval", len) == 0 && *value > 0) {
+        *mode = ARCHIVE_SYNC_INTERVAL;
+    } else if (len == 7 && strncasecmp(spec, "records", len) == 0 && *value > 0) {
+        *mode = ARCHIVE_SYNC_RECORDS;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+void archive_set_sync(ArchiveWriter* writer, ArchiveSyncMode mode, int value) {
+    writer->sync_mode = mode;
+    writer->sync_value = value;
+    writer->last_sync_ms = now_ms();
+}
+
+// 同步所有有新数据的文件：先等待进行中的写入完成，再一次处理所有脏文件；
+// 使用io_uring时所有FSYNC作为一批提交
+void archive_sync(ArchiveWriter* writer) {
+    archive_drain(writer);
+    
+    int count = 0;
+    for (ArchiveFile* file = writer->lru_head; file; file = file->lru_next) {
+        if (!file->dirty) continue;
+        file->dirty = 0;
+        count++;
+        
+        struct io_uring_sqe* sqe = writer->ring ? uring_get_sqe(writer->ring) : NULL;
+        if (!sqe && writer->ring && writer->sync_inflight > 0) {
+            uring_submit(writer->ring, 0);
+            sqe = uring_get_sqe(writer->ring);
+        }
+        if (sqe) {
+            sqe->opcode = IORING_OP_FSYNC;
+            sqe->fd = file->fd;
+            sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+            sqe->user_data = ARCHIVE_SYNC_TAG;
+            writer->sync_inflight++;
+        } else if (fdatasync(file->fd) < 0) {
+            seedlink_log(LOG_ERROR, "同步文件失败 %s: %s", file->path, strerror(errno));
+        }
+    }
+    
+    while (writer->ring && writer->sync_inflight > 0) {
+        if (uring_submit(writer->ring, 1) < 0 && errno != EBUSY) break;
+        writer->submits++;
+        uring_reap(writer->ring, handle_completion, writer);
+    }
+    
+    writer->syncs += count;
+    if (count > 0) writer->sync_passes++;
+    writer->unsynced_records = 0;
+    writer->last_sync_ms = now_ms();
+}
+
+// 按策略判断是否需要同步，由存档线程在每批写入后调用
+void archive_maybe_sync(ArchiveWriter* writer) {
+    if (writer->unsynced_records == 0) return;
+    
+    switch (writer->sync_mode) {
+        case ARCHIVE_SYNC_INTERVAL:
+            if (now_ms() - writer->last_sync_ms >= writer->sync_value) archive_sync(writer);
+            break;
+        case ARCHIVE_SYNC_RECORDS:
+            if (writer->unsynced_records >= (uint64_t)writer->sync_value) archive_sync(writer);
+            break;
+        default:
+            break;
+    }
+}
+
+// 关闭空闲超时的文件，从最久未使用的一端开始检查
+void archive_close_idle(ArchiveWriter* writer) {
+    int64_t now = now_ms();
+    while (writer->lru_tail && now - writer->lru_tail->last_write_ms >= writer->idle_timeout_ms) {
+        close_file(writer, writer->lru_tail);
+        writer->idle_closes++;
+    }
+}
+
+void archive_destroy(ArchiveWriter* writer) {
+    if (!writer) return;
+    archive_drain(writer);
+    while (writer->lru_tail) {
+        close_file(writer, writer->lru_tail);
+    }
+    if (writer->ring) {
+        uring_exit(writer->ring);
+        free(writer->ring);
+        free(writer->requests);
+    }
+    free(writer->buckets);
+    free(writer);
+}
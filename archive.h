@@ -0,0 +1,143 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include "miniseed.h"
+#include "uring.h"
+#include "archive_index.h"
+
+#define ARCHIVE_DEFAULT_MAX_OPEN 1024       // 默认最多占用的fd数（所有存档线程合计），数据文件和索引各占一个
+#define ARCHIVE_IDLE_TIMEOUT_MS 60000       // 文件超过该时间没有写入则关闭
+#define ARCHIVE_PATH_SIZE 512
+#define ARCHIVE_URING_ENTRIES 256           // io_uring队列深度，也是同时进行的写入数上限
+#define ARCHIVE_MAX_BUFFERS 8               // 可注册的固定缓冲区数
+#define ARCHIVE_SYNC_TAG UINT64_MAX         // io_uring FSYNC请求的user_data
+#define ARCHIVE_PREALLOC_ALIGN (1024 * 1024)        // 预分配按1 MiB对齐
+#define ARCHIVE_PREALLOC_MAX (256 * 1024 * 1024)    // 单次预分配的上限
+
+// 存档目录结构
+typedef enum {
+    ARCHIVE_LAYOUT_FLAT,    // 根目录下每个通道一个文件：NET_STA_LOC_CHA.mseed
+    ARCHIVE_LAYOUT_SDS      // SDS日文件：YEAR/NET/STA/CHA.D/NET.STA.LOC.CHA.D.YEAR.DAY
+} ArchiveLayout;
+
+// 持久化策略：把已写入的数据fdatasync到磁盘的时机
+typedef enum {
+    ARCHIVE_SYNC_NONE,      // 不主动同步，由操作系统决定
+    ARCHIVE_SYNC_INTERVAL,  // 每隔N毫秒同步一次所有有新数据的文件
+    ARCHIVE_SYNC_RECORDS,   // 每写入N条记录同步一次所有有新数据的文件
+    ARCHIVE_SYNC_CLOSE      // 只在文件关闭时同步（换日、空闲、淘汰、退出）
+} ArchiveSyncMode;
+
+// 一个打开的存档文件
+typedef struct ArchiveFile {
+    char path[ARCHIVE_PATH_SIZE];
+    uint64_t hash;
+    uint64_t channel;                   // 通道的NSLC哈希
+    int day;                            // SDS日文件的日期（年*1000+年积日）
+    int fd;
+    int fds;                            // 数据文件和索引合计占用的fd数
+    off_t offset;                       // 下一次写入的位置
+    off_t allocated;                    // 已预分配到的位置（不改变文件大小），关闭时释放offset之后的部分
+    int64_t last_write_ms;
+    int inflight;                       // 尚未完成的异步写入数，关闭前必须为0
+    int dirty;                          // 上次同步之后有新写入
+    ArchiveIndex index;                 // 时间索引，与数据文件同名加.idx
+    struct ArchiveFile* hash_next;
+    struct ArchiveFile* lru_prev;       // 越靠近表头越近被使用
+    struct ArchiveFile* lru_next;
+} ArchiveFile;
+
+// 一个进行中的io_uring写入
+typedef struct {
+    ArchiveFile* file;
+    const unsigned char* data;
+    size_t length;
+    off_t offset;
+    int buffer;                         // 所在缓冲区序号，-1表示不属于登记的缓冲区
+    int next_free;
+} ArchiveRequest;
+
+// 存档写入器：按文件名缓存打开的文件描述符
+// 打开的文件连同索引占用的fd数受fd预算限制，超过时关闭最久未使用的文件；写入用pwrite追加到记录的偏移处。
+// SDS布局按记录开始时间选择日文件，跨午夜的记录整条写入开始时间所在日的文件；
+// 某通道开始写新一天的文件时关闭该通道前一天的文件。
+// 启用预分配时，写入超出已分配的区域前用fallocate(KEEP_SIZE)按估计的一天数据量一次分配，
+// 交错追加的多个文件各自得到大块连续的extent，追加也不再每次分配块；文件关闭时释放未用的部分。
+// 每个数据文件维护一个时间索引（偏移、起止时间、采样点数），条目按批追加，
+// 存档线程每批写入后调用archive_flush_index写出，之后即可按时间窗口查找。
+// 持久化按批进行：一次遍历所有有新数据的文件依次fdatasync（io_uring时作为一批FSYNC提交），
+// 未设置为不同步时，文件关闭前也会同步，因此丢失数据的时间窗口有界。
+// 启用io_uring后，archive_write只填写SQE，由archive_submit一次提交整批写入，
+// 完成事件在之后的提交或等待时回收；数据在写入完成前必须保持有效。
+// 每个存档线程一个写入器，内部不加锁
+typedef struct {
+    char root[256];                     // 存档根目录
+    ArchiveLayout layout;
+    ArchiveFile** buckets;
+    size_t bucket_mask;
+    ArchiveFile* lru_head;
+    ArchiveFile* lru_tail;
+    int open_count;
+    int open_fds;                       // 数据文件和索引合计占用的fd数
+    int max_open;                       // fd预算，每个打开的文件最多占两个
+    int idle_timeout_ms;
+    
+    // 统计
+    uint64_t writes;
+    uint64_t opens;
+    uint64_t evictions;                 // 因超出fd预算而关闭
+    uint64_t idle_closes;               // 因空闲超时而关闭
+    uint64_t rotations;                 // 因换日而关闭
+    uint64_t submits;                   // io_uring提交次数
+    uint64_t syncs;                     // fdatasync的文件数
+    uint64_t sync_passes;               // 同步的批数
+    uint64_t preallocations;            // fallocate次数
+    
+    int preallocate;                    // 写入前预分配文件空间
+    
+    // 持久化策略
+    ArchiveSyncMode sync_mode;
+    int sync_value;                     // 间隔毫秒数或记录数
+    int64_t last_sync_ms;
+    uint64_t unsynced_records;
+    int sync_inflight;                  // 进行中的io_uring FSYNC数
+    
+    // io_uring后端，未启用时为NULL
+    URing* ring;
+    ArchiveRequest* requests;
+    int free_request;
+    int inflight;
+    struct iovec buffers[ARCHIVE_MAX_BUFFERS];  // 按缓冲区跟踪进行中的写入
+    int buffer_count;
+    int buffers_registered;             // 已注册给内核，可用WRITE_FIXED
+    int write_fixed_supported;          // 内核支持IORING_OP_WRITE_FIXED
+    int buffer_inflight[ARCHIVE_MAX_BUFFERS];
+} ArchiveWriter;
+
+// 函数声明
+ArchiveWriter* archive_create(const char* root, ArchiveLayout layout, int max_open, int idle_timeout_ms);
+int archive_parse_layout(const char* name);
+void archive_format_path(const ArchiveWriter* writer, const MiniSeedInfo* info, char* path, size_t size);
+int archive_write(ArchiveWriter* writer, const MiniSeedInfo* info, const unsigned char* data, size_t length);
+void archive_set_preallocate(ArchiveWriter* writer, int enable);
+void archive_flush_index(ArchiveWriter* writer);
+void archive_close_idle(ArchiveWriter* writer);
+
+// 持久化
+int archive_parse_sync(const char* spec, ArchiveSyncMode* mode, int* value);
+void archive_set_sync(ArchiveWriter* writer, ArchiveSyncMode mode, int value);
+void archive_sync(ArchiveWriter* writer);
+void archive_maybe_sync(ArchiveWriter* writer);
+
+// io_uring后端
+int archive_enable_uring(ArchiveWriter* writer, unsigned entries);
+int archive_register_buffers(ArchiveWriter* writer, const struct iovec* buffers, int count);
+int archive_submit(ArchiveWriter* writer);
+void archive_wait_buffer(ArchiveWriter* writer, int buffer);
+void archive_drain(ArchiveWriter* writer);
+void archive_destroy(ArchiveWriter* writer);
+
+#endif
@@ -0,0 +1,352 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "archive_index.h"
+#include "seedlink.h"
+
+#define INDEX_PATH_SIZE 520
+#define INDEX_PROBE_SIZE 512            // 补建索引时读取的记录头长度，也是没有Blockette 1000时的记录长度
+#define INDEX_EXTRACT_BUFFER (64 * 1024) // 提取时相邻记录合并读取的上限
+
+// 映射到内存的索引文件，只读
+typedef struct {
+    void* map;
+    size_t map_size;
+    const ArchiveIndexEntry* entries;
+    size_t count;
+    uint32_t flags;
+} IndexMap;
+
+static void index_path(const char* data_path, char* path, size_t size) {
+    snprintf(path, size, "%s%s", data_path, ARCHIVE_INDEX_SUFFIX);
+}
+
+// 清空索引文件，只保留文件头
+static int index_reset(ArchiveIndex* index) {
+    ArchiveIndexHeader header;
+    memcpy(header.magic, ARCHIVE_INDEX_MAGIC, sizeof(header.magic));
+    header.version = ARCHIVE_INDEX_VERSION;
+    header.flags = 0;
+
+    if (ftruncate(index->fd, 0) < 0 ||
+        pwrite(index->fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+        return -1;
+    }
+    index->offset = sizeof(header);
+    index->flags = 0;
+    index->last_start = INT64_MIN;
+    index->last_end = INT64_MIN;
+    return 0;
+}
+
+// 从数据文件的from处开始逐条解析记录，补建缺少的索引条目
+static void index_scan(ArchiveIndex* index, const char* data_path, off_t from, off_t to) {
+    int fd = open(data_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        seedlink_log(LOG_ERROR, "无法打开文件 %s: %s", data_path, strerror(errno));
+        return;
+    }
+
+    unsigned char record[INDEX_PROBE_SIZE];
+    uint64_t count = 0;
+    off_t offset = from;
+    while (offset < to) {
+        size_t want = to - offset < INDEX_PROBE_SIZE ? (size_t)(to - offset) : INDEX_PROBE_SIZE;
+        ssize_t n = pread(fd, record, want, offset);
+        MiniSeedInfo info;
+        if (n < (ssize_t)sizeof(MiniSeedHeader) || miniseed_decode(record, n, &info) < 0) break;
+        if (info.record_length < sizeof(MiniSeedHeader) || info.record_length > MINISEED_MAX_RECORD_LENGTH ||
+            offset + (off_t)info.record_length > to) {
+            break;
+        }
+        archive_index_add(index, offset, &info, info.record_length);
+        offset += info.record_length;
+        count++;
+    }
+    close(fd);
+    archive_index_flush(index);
+
+    if (offset < to) {
+        seedlink_log(LOG_WARN, "%s 在偏移%lld处无法识别，之后的%lld字节没有索引",
+                     data_path, (long long)offset, (long long)(to - offset));
+    }
+    seedlink_log(LOG_INFO, "为 %s 补建了%llu条索引", data_path, (unsigned long long)count);
+}
+
+// 打开数据文件对应的索引，与数据文件核对：
+// 索引缺少尾部条目时从数据文件补建，索引超出数据文件或无法识别时整个重建
+int archive_index_open(ArchiveIndex* index, const char* data_path, off_t data_size) {
+    char path[INDEX_PATH_SIZE];
+    index_path(data_path, path, sizeof(path));
+
+    memset(index, 0, sizeof(*index));
+    index->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (index->fd < 0) {
+        seedlink_log(LOG_ERROR, "无法打开索引文件 %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    ArchiveIndexHeader header;
+    struct stat st;
+    off_t covered = 0;  // 已有索引覆盖到的数据文件位置
+    int valid = fstat(index->fd, &st) == 0 && st.st_size >= (off_t)sizeof(header) &&
+                pread(index->fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+                memcmp(header.magic, ARCHIVE_INDEX_MAGIC, sizeof(header.magic)) == 0 &&
+                header.version == ARCHIVE_INDEX_VERSION;
+
+    if (valid) {
+        // 去掉写了一半的条目
+        off_t size = st.st_size - (st.st_size - sizeof(header)) % sizeof(ArchiveIndexEntry);
+        index->offset = size;
+        index->flags = header.flags;
+        index->last_start = INT64_MIN;
+        index->last_end = INT64_MIN;
+
+        ArchiveIndexEntry last;
+        if (size > (off_t)sizeof(header)) {
+            if (pread(index->fd, &last, sizeof(last), size - sizeof(last)) != (ssize_t)sizeof(last)) {
+                valid = 0;
+            } else {
+                covered = last.offset + last.record_length;
+                index->last_start = last.start_time;
+                index->last_end = last.end_time;
+            }
+        }
+        if (covered > data_size) valid = 0;
+        if (valid && size != st.st_size && ftruncate(index->fd, size) < 0) valid = 0;
+    }
+
+    if (!valid) {
+        covered = 0;
+        if (index_reset(index) < 0) {
+            seedlink_log(LOG_ERROR, "无法写入索引文件 %s: %s", path, strerror(errno));
+            close(index->fd);
+            index->fd = -1;
+            return -1;
+        }
+    }
+
+    if (covered < data_size) index_scan(index, data_path, covered, data_size);
+    return 0;
+}
+
+// 写入失败后清空并关闭索引文件，下次打开时整个重建，避免索引中间缺少条目或标志与条目不符
+static void index_discard(ArchiveIndex* index) {
+    if (ftruncate(index->fd, 0) < 0) {
+        seedlink_log(LOG_ERROR, "清空索引失败: %s", strerror(errno));
+    }
+    close(index->fd);
+    index->fd = -1;
+    index->pending = 0;
+}
+
+// 添加一条记录的索引条目，缓存满时先写出已有的条目
+int archive_index_add(ArchiveIndex* index, off_t offset, const MiniSeedInfo* info, size_t length) {
+    if (index->fd < 0) return -1;
+    if (index->pending == ARCHIVE_INDEX_BATCH && archive_index_flush(index) < 0) return -1;
+
+    int64_t end_time = miniseed_end_time(info);
+
+    // 第一次出现乱序时在文件头中记录，之后的查找不再使用二分查找
+    if (!(index->flags & ARCHIVE_INDEX_UNORDERED) &&
+        (info->start_time < index->last_start || end_time < index->last_end)) {
+        index->flags |= ARCHIVE_INDEX_UNORDERED;
+        if (pwrite(index->fd, &index->flags, sizeof(index->flags),
+                   offsetof(ArchiveIndexHeader, flags)) != (ssize_t)sizeof(index->flags)) {
+            // 标志没有写入时，之后按二分查找会漏掉乱序的记录
+            seedlink_log(LOG_ERROR, "写入索引失败: %s", strerror(errno));
+            index_discard(index);
+            return -1;
+        }
+    }
+    index->last_start = info->start_time;
+    index->last_end = end_time;
+
+    ArchiveIndexEntry* entry = &index->entries[index->pending++];
+    entry->offset = (uint64_t)offset;
+    entry->start_time = info->start_time;
+    entry->end_time = end_time;
+    entry->num_samples = info->num_samples;
+    entry->record_length = (uint32_t)length;
+    return 0;
+}
+
+// 追加缓存的条目，失败时清空索引文件
+int archive_index_flush(ArchiveIndex* index) {
+    if (index->fd < 0 || index->pending == 0) return 0;
+
+    size_t size = index->pending * sizeof(ArchiveIndexEntry);
+    const char* data = (const char*)index->entries;
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = pwrite(index->fd, data + done, size - done, index->offset + done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            seedlink_log(LOG_ERROR, "写入索引失败: %s", strerror(errno));
+            index_discard(index);
+            return -1;
+        }
+        done += n;
+    }
+    index->offset += size;
+    index->pending = 0;
+    return 0;
+}
+
+void archive_index_close(ArchiveIndex* index) {
+    if (index->fd < 0) return;
+    archive_index_flush(index);
+    if (index->fd >= 0) close(index->fd);
+    index->fd = -1;
+}
+
+// 只读映射索引文件
+static int index_map(const char* data_path, IndexMap* map) {
+    char path[INDEX_PATH_SIZE];
+    index_path(data_path, path, sizeof(path));
+    memset(map, 0, sizeof(*map));
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        seedlink_log(LOG_ERROR, "无法打开索引文件 %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(ArchiveIndexHeader)) {
+        seedlink_log(LOG_ERROR, "索引文件 %s 无效", path);
+        close(fd);
+        return -1;
+    }
+
+    map->map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map->map == MAP_FAILED) {
+        seedlink_log(LOG_ERROR, "无法映射索引文件 %s: %s", path, strerror(errno));
+        map->map = NULL;
+        return -1;
+    }
+
+    const ArchiveIndexHeader* header = (const ArchiveIndexHeader*)map->map;
+    if (memcmp(header->magic, ARCHIVE_INDEX_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != ARCHIVE_INDEX_VERSION) {
+        seedlink_log(LOG_ERROR, "索引文件 %s 无效", path);
+        munmap(map->map, st.st_size);
+        map->map = NULL;
+        return -1;
+    }
+    map->map_size = st.st_size;
+    map->flags = header->flags;
+    map->entries = (const ArchiveIndexEntry*)(header + 1);
+    map->count = (st.st_size - sizeof(ArchiveIndexHeader)) / sizeof(ArchiveIndexEntry);
+    return 0;
+}
+
+static void index_unmap(IndexMap* map) {
+    if (map->map) munmap(map->map, map->map_size);
+    map->map = NULL;
+}
+
+// 条目是否与时间窗口[start_time, end_time)重叠，没有采样点的记录按开始时间判断
+static int entry_overlaps(const ArchiveIndexEntry* entry, int64_t start_time, int64_t end_time) {
+    return entry->start_time < end_time &&
+           (entry->end_time > start_time || entry->start_time >= start_time);
+}
+
+// 按时间顺序追加的索引二分查找第一个可能重叠的条目，再向后扫描到开始时间超出窗口；
+// 有乱序记录时顺序扫描所有条目
+static void index_find(const IndexMap* map, int64_t start_time, int64_t end_time, ArchiveIndexRange* range) {
+    size_t first = 0, last = map->count;
+
+    if (!(map->flags & ARCHIVE_INDEX_UNORDERED)) {
+        size_t lo = 0, hi = map->count;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            const ArchiveIndexEntry* entry = &map->entries[mid];
+            if (entry->end_time <= start_time && entry->start_time < start_time) lo = mid + 1;
+            else hi = mid;
+        }
+        first = lo;
+        last = first;
+        while (last < map->count && map->entries[last].start_time < end_time) last++;
+    }
+
+    range->first = first;
+    range->last = last;
+    range->records = 0;
+    range->bytes = 0;
+    for (size_t i = first; i < last; i++) {
+        if (!entry_overlaps(&map->entries[i], start_time, end_time)) continue;
+        range->records++;
+        range->bytes += map->entries[i].record_length;
+    }
+}
+
+// 查找数据文件中与时间窗口重叠的记录
+int archive_index_lookup(const char* data_path, int64_t start_time, int64_t end_time, ArchiveIndexRange* range) {
+    IndexMap map;
+    if (index_map(data_path, &map) < 0) return -1;
+    index_find(&map, start_time, end_time, range);
+    index_unmap(&map);
+    return 0;
+}
+
+// 把数据文件中与时间窗口重叠的记录写到out，相邻的记录合并为一次读取；返回写出的记录数
+int archive_index_extract(const char* data_path, int64_t start_time, int64_t end_time, FILE* out) {
+    IndexMap map;
+    if (index_map(data_path, &map) < 0) return -1;
+
+    ArchiveIndexRange range;
+    index_find(&map, start_time, end_time, &range);
+
+    int fd = open(data_path, O_RDONLY | O_CLOEXEC);
+    unsigned char* buffer = (unsigned char*)malloc(INDEX_EXTRACT_BUFFER);
+    if (fd < 0 || !buffer) {
+        seedlink_log(LOG_ERROR, "无法打开文件 %s: %s", data_path, strerror(errno));
+        if (fd >= 0) close(fd);
+        free(buffer);
+        index_unmap(&map);
+        return -1;
+    }
+
+    int written = 0, failed = 0;
+    uint64_t run_offset = 0;
+    size_t run_length = 0;
+    for (size_t i = range.first; i <= range.last && !failed; i++) {
+        const ArchiveIndexEntry* entry = i < range.last ? &map.entries[i] : NULL;
+        if (entry && (!entry_overlaps(entry, start_time, end_time) ||
+                      entry->record_length > INDEX_EXTRACT_BUFFER)) {
+            continue;
+        }
+
+        // 与当前连续区间相邻且放得下时并入，否则先读出并写出当前区间
+        if (entry && run_length > 0 && entry->offset == run_offset + run_length &&
+            run_length + entry->record_length <= INDEX_EXTRACT_BUFFER) {
+            run_length += entry->record_length;
+            written++;
+            continue;
+        }
+        if (run_length > 0) {
+            if (pread(fd, buffer, run_length, run_offset) != (ssize_t)run_length ||
+                fwrite(buffer, 1, run_length, out) != run_length) {
+                seedlink_log(LOG_ERROR, "提取 %s 失败: %s", data_path, strerror(errno));
+                failed = 1;
+            }
+        }
+        if (entry) {
+            run_offset = entry->offset;
+            run_length = entry->record_length;
+            written++;
+        }
+    }
+
+    close(fd);
+    free(buffer);
+    index_unmap(&map);
+    return failed ? -1 : written;
+}
@@ -0,0 +1,64 @@
+#ifndef ARCHIVE_INDEX_H
+#define ARCHIVE_INDEX_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "miniseed.h"
+
+#define ARCHIVE_INDEX_SUFFIX ".idx"         // 索引文件名：数据文件名加后缀
+#define ARCHIVE_INDEX_MAGIC "MSEEDIDX"
+#define ARCHIVE_INDEX_VERSION 1
+#define ARCHIVE_INDEX_BATCH 32              // 每个文件缓存的条目数，满了或文件关闭时写出
+#define ARCHIVE_INDEX_UNORDERED 0x1         // 有记录没有按时间顺序追加，查找时顺序扫描
+
+// 索引文件头（16字节），之后是连续的条目，均为本机字节序
+#pragma pack(1)
+typedef struct {
+    char        magic[8];
+    uint32_t    version;
+    uint32_t    flags;
+} ArchiveIndexHeader;
+
+// 一条记录的索引条目（32字节）
+typedef struct {
+    uint64_t    offset;             // 记录在数据文件中的偏移
+    int64_t     start_time;         // 开始时间（纳秒）
+    int64_t     end_time;           // 结束时间（纳秒）
+    uint32_t    num_samples;
+    uint32_t    record_length;      // 写入的字节数
+} ArchiveIndexEntry;
+#pragma pack()
+
+// 一个存档文件的索引写入状态，随数据文件打开和关闭
+// 条目先缓存在内存中，批量追加到索引文件；索引不单独同步，
+// 打开时与数据文件核对，缺少的尾部条目从数据文件补建，因此异常退出后也能恢复
+typedef struct {
+    int fd;
+    off_t offset;                   // 下一个条目的写入位置
+    uint32_t flags;
+    int64_t last_start;             // 最后一条记录的时间，用于判断是否按顺序追加
+    int64_t last_end;
+    int pending;                    // 尚未写出的条目数
+    ArchiveIndexEntry entries[ARCHIVE_INDEX_BATCH];
+} ArchiveIndex;
+
+// 查找结果：与时间窗口重叠的条目范围
+typedef struct {
+    size_t first;                   // 第一个可能重叠的条目序号
+    size_t last;                    // 最后一个可能重叠的条目序号之后
+    uint64_t records;               // 实际重叠的记录数
+    uint64_t bytes;                 // 实际重叠的记录字节数
+} ArchiveIndexRange;
+
+// 写入
+int archive_index_open(ArchiveIndex* index, const char* data_path, off_t data_size);
+int archive_index_add(ArchiveIndex* index, off_t offset, const MiniSeedInfo* info, size_t length);
+int archive_index_flush(ArchiveIndex* index);
+void archive_index_close(ArchiveIndex* index);
+
+// 查找和提取
+int archive_index_lookup(const char* data_path, int64_t start_time, int64_t end_time, ArchiveIndexRange* range);
+int archive_index_extract(const char* data_path, int64_t start_time, int64_t end_time, FILE* out);
+
+#endif
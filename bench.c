@@ -0,0 +1,425 @@
+#include "bench.h"
+#include "server.h"
+#include "pipeline.h"
+
+// 每个数据包各阶段的耗时（纳秒）
+typedef struct {
+    uint32_t* samples[BENCH_STAGE_COUNT];
+    uint32_t* total;
+    int64_t* start;         // 开始处理的时刻
+    int64_t* submitted;     // pipeline_submit返回的时刻
+    size_t count;
+    size_t capacity;
+} BenchTimings;
+
+// 回环订阅者：连接转发服务器，按提交顺序记下每条记录完整到达的时刻。
+// 转发保持顺序，客户端队列不小于在途记录数，不会丢弃，第k条收到的记录就是第k条提交的记录
+typedef struct {
+    int fd;
+    const uint32_t* lengths;    // 第k条提交记录的长度，提交前写入
+    int64_t* arrival;
+    atomic_size_t received;
+    uint64_t bytes;
+} BenchSubscriber;
+
+static const char* stage_names[BENCH_STAGE_COUNT] = {
+    "recv/frame", "parse", "header", "submit", "deliver"
+};
+
+// 单调时钟纳秒数
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void write_le32(unsigned char* p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (v >> (8 * i)) & 0xFF;
+}
+
+static void write_le64(unsigned char* p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (v >> (8 * i)) & 0xFF;
+}
+
+// 读取整个文件
+static unsigned char* read_file(const char* path, size_t* size) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) {
+        seedlink_log(LOG_ERROR, "无法打开文件 %s: %s", path, strerror(errno));
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    long len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    
+    unsigned char* data = malloc(len > 0 ? len : 1);
+    if (data) *size = fread(data, 1, len, fp);
+    fclose(fp);
+    return data;
+}
+
+// 把所有文件中的记录按SeedLink格式封装成一段连续的数据流，返回数据包数
+// 没有Blockette 1000的miniSEED 2记录按512字节处理
+static size_t build_stream(char* const files[], int file_count, int protocol,
+                           unsigned char** stream, size_t* stream_size) {
+    size_t capacity = 1024 * 1024, used = 0, packets = 0;
+    unsigned char* out = malloc(capacity);
+    if (!out) return 0;
+    
+    for (int f = 0; f < file_count; f++) {
+        size_t size = 0;
+        unsigned char* data = read_file(files[f], &size);
+        if (!data) continue;
+        
+        size_t offset = 0;
+        while (offset + sizeof(MiniSeedHeader) <= size) {
+            MiniSeedInfo info;
+            size_t avail = size - offset;
+            if (miniseed_decode(data + offset, avail, &info) < 0) {
+                offset += SEEDLINK_V3_PAYLOAD_SIZE;
+                continue;
+            }
+            size_t length = info.record_length;
+            if (info.format == 2 && length == avail && avail > SEEDLINK_V3_PAYLOAD_SIZE) {
+                length = SEEDLINK_V3_PAYLOAD_SIZE;
+            }
+            if (length > avail || length > MINISEED_MAX_RECORD_LENGTH) break;
+            
+            // v3只能传输512字节的miniSEED 2记录
+            if (protocol == 3 && (info.format != 2 || length != SEEDLINK_V3_PAYLOAD_SIZE)) {
+                offset += length;
+                continue;
+            }
+            
+            char station_id[32];
+            int id_len = snprintf(station_id, sizeof(station_id), "%s_%s", info.network, info.station);
+            size_t header_len = protocol == 4 ? SEEDLINK_V4_HEADER_SIZE + id_len : SEEDLINK_V3_HEADER_SIZE;
+            if (used + header_len + length > capacity) {
+                capacity *= 2;
+                unsigned char* grown = realloc(out, capacity);
+                if (!grown) break;
+                out = grown;
+            }
+            
+            unsigned char* p = out + used;
+            if (protocol == 4) {
+                p[0] = 'S';
+                p[1] = 'E';
+                p[2] = info.format == 3 ? '3' : '2';
+                p[3] = 'D';
+                write_le32(p + 4, (uint32_t)length);
+                write_le64(p + 8, packets);
+                p[16] = (unsigned char)id_len;
+                memcpy(p + SEEDLINK_V4_HEADER_SIZE, station_id, id_len);
+            } else {
+                char header[SEEDLINK_V3_HEADER_SIZE + 1];
+                snprintf(header, sizeof(header), "SL%06X", (unsigned)(packets & 0xFFFFFF));
+                memcpy(p, header, SEEDLINK_V3_HEADER_SIZE);
+            }
+            memcpy(p + header_len, data + offset, length);
+            used += header_len + length;
+            packets++;
+            offset += length;
+        }
+        free(data);
+    }
+    
+    *stream = out;
+    *stream_size = used;
+    return packets;
+}
+
+static int compare_u32(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+// 排序后的第p分位数
+static uint32_t percentile(const uint32_t* sorted, size_t count, double p) {
+    size_t index = (size_t)(p * (count - 1) + 0.5);
+    return sorted[index];
+}
+
+static void print_stage(const char* name, uint32_t* samples, size_t count) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < count; i++) sum += samples[i];
+    qsort(samples, count, sizeof(uint32_t), compare_u32);
+    
+    printf("  %-12s %10.0f %10u %10u %10u %10u\n", name, (double)sum / count,
+           percentile(samples, count, 0.50), percentile(samples, count, 0.99),
+           percentile(samples, count, 0.999), samples[count - 1]);
+}
+
+static void timings_free(BenchTimings* t) {
+    for (int s = 0; s < BENCH_STAGE_COUNT; s++) free(t->samples[s]);
+    free(t->total);
+    free(t->start);
+    free(t->submitted);
+}
+
+// 分配所有计时数组，任何一个失败都返回-1
+static int timings_alloc(BenchTimings* t, size_t capacity) {
+    memset(t, 0, sizeof(*t));
+    t->capacity = capacity;
+    int ok = 1;
+    for (int s = 0; s < BENCH_STAGE_COUNT; s++) {
+        t->samples[s] = malloc(capacity * sizeof(uint32_t));
+        if (!t->samples[s]) ok = 0;
+    }
+    t->total = malloc(capacity * sizeof(uint32_t));
+    t->start = malloc(capacity * sizeof(int64_t));
+    t->submitted = malloc(capacity * sizeof(int64_t));
+    return ok && t->total && t->start && t->submitted ? 0 : -1;
+}
+
+static uint32_t clamp_ns(int64_t ns) {
+    return ns < 0 ? 0 : (ns > UINT32_MAX ? UINT32_MAX : (uint32_t)ns);
+}
+
+// 按时间差记录一个阶段的耗时
+static void record_stage(BenchTimings* t, BenchStage stage, int64_t start, int64_t end) {
+    t->samples[stage][t->count] = clamp_ns(end - start);
+}
+
+// 回环订阅者线程：跳过欢迎消息后按提交的记录长度切分数据，直到服务器关闭连接
+static void* subscriber_thread(void* arg) {
+    BenchSubscriber* sub = (BenchSubscriber*)arg;
+    unsigned char* buf = malloc(SEEDLINK_RECV_BUFFER_SIZE);
+    size_t partial = 0;     // 当前记录已收到的字节数
+    int welcome = 1;
+    if (!buf) return NULL;
+    
+    for (;;) {
+        ssize_t n = recv(sub->fd, buf, SEEDLINK_RECV_BUFFER_SIZE, 0);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            break;
+        }
+        int64_t now = now_ns();
+        sub->bytes += n;
+        
+        size_t avail = n;
+        if (welcome) {
+            unsigned char* eol = memchr(buf, '\n', n);
+            if (!eol) continue;
+            avail -= eol - buf + 1;
+            welcome = 0;
+        }
+        size_t k = atomic_load_explicit(&sub->received, memory_order_relaxed);
+        while (avail > 0 && sub->lengths[k] > 0) {
+            size_t need = sub->lengths[k] - partial;
+            if (avail < need) {
+                partial += avail;
+                break;
+            }
+            avail -= need;
+            partial = 0;
+            sub->arrival[k++] = now;
+        }
+        atomic_store_explicit(&sub->received, k, memory_order_release);
+    }
+    free(buf);
+    return NULL;
+}
+
+// 连接到本机的转发服务器，等事件循环登记该客户端后返回socket
+static int connect_subscriber(TCPServer* server) {
+    struct sockaddr_in addr;
+    socklen_t addrlen = sizeof(addr);
+    for (int i = 0; i < 1000 && !server->running; i++) usleep(1000);
+    if (!server->running || getsockname(server->server_fd, (struct sockaddr*)&addr, &addrlen) < 0) return -1;
+    
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    
+    int clients = 0;
+    for (int i = 0; i < 1000 && clients == 0; i++) {
+        pthread_mutex_lock(&server->mutex);
+        clients = server->client_count;
+        pthread_mutex_unlock(&server->mutex);
+        if (clients == 0) usleep(1000);
+    }
+    if (clients == 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// 从内存中的语料驱动完整的处理流程：切分、解析、解码，再经pipeline_submit交给存档和转发线程，
+// 由本机的回环订阅者接收转发的记录。不连接上游，每个阶段用单调时钟计时，
+// 最后输出吞吐量和各阶段的延迟分位数
+int bench_run(char* const files[], int file_count, const BenchOptions* options) {
+    unsigned char* stream = NULL;
+    size_t stream_size = 0;
+    size_t packets = build_stream(files, file_count, options->protocol, &stream, &stream_size);
+    if (packets == 0) {
+        seedlink_log(LOG_ERROR, "语料中没有可用的记录");
+        free(stream);
+        return -1;
+    }
+    
+    BenchTimings timings;
+    int timings_ok = timings_alloc(&timings, packets * options->loops) == 0;
+    BenchSubscriber sub;
+    memset(&sub, 0, sizeof(sub));
+    sub.fd = -1;
+    uint32_t* lengths = calloc(timings.capacity + 1, sizeof(uint32_t));
+    sub.lengths = lengths;
+    sub.arrival = malloc(timings.capacity * sizeof(int64_t));
+    unsigned char* recv_buf = malloc(SEEDLINK_RECV_BUFFER_SIZE);
+    
+    // 转发服务器监听临时端口，不与正常运行的实例冲突。客户端队列容纳全部在途记录，
+    // 另加一次sendmsg的记录数：订阅者可能在事件循环移出已发送的记录之前就收到它们
+    TCPServer* server = server_create(0);
+    if (server) server_set_client_policy(server, SERVER_POLICY_DROP_OLDEST, BENCH_WINDOW + SERVER_SEND_BATCH);
+    pthread_t server_thread, sub_thread;
+    int server_started = server && pthread_create(&server_thread, NULL, (void*)server_start, server) == 0;
+    if (server_started) sub.fd = connect_subscriber(server);
+    int sub_started = sub.fd >= 0 && pthread_create(&sub_thread, NULL, subscriber_thread, &sub) == 0;
+    
+    // 两个阶段都用阻塞策略：基准测试不丢记录，也不在数据目录留下溢写文件
+    PipelineOptions pipeline_options;
+    pipeline_default_options(&pipeline_options);
+    pipeline_options.archive_root = options->output_dir;
+    pipeline_options.archive_layout = options->layout;
+    pipeline_options.archive_policy = QUEUE_POLICY_BLOCK;
+    pipeline_options.fanout_policy = QUEUE_POLICY_BLOCK;
+    Pipeline* pipeline = sub_started ? pipeline_create(server, &pipeline_options) : NULL;
+    
+    if (!timings_ok || !lengths || !sub.arrival || !recv_buf || !pipeline || pipeline_start(pipeline) < 0) {
+        seedlink_log(LOG_ERROR, "基准测试初始化失败");
+        pipeline_destroy(pipeline);
+        if (server_started) {
+            server_stop(server);
+            pthread_join(server_thread, NULL);
+        }
+        if (sub_started) pthread_join(sub_thread, NULL);
+        if (sub.fd >= 0) close(sub.fd);
+        server_destroy(server);
+        free(recv_buf);
+        free(sub.arrival);
+        free(lengths);
+        timings_free(&timings);
+        free(stream);
+        return -1;
+    }
+    
+    seedlink_log(LOG_INFO, "基准测试: %zu 个数据包 (%zu 字节) x %d 轮, 协议 v%d, %d 个存档线程",
+                 packets, stream_size, options->loops, options->protocol, pipeline->shard_count);
+    
+    uint64_t bytes = 0;
+    int64_t bench_start = now_ns();
+    for (int loop = 0; loop < options->loops; loop++) {
+        size_t offset = 0, head = 0, tail = 0;
+        while (1) {
+            // 在途记录达到窗口时先入队暂存的记录，再等订阅者收到
+            if (timings.count - atomic_load_explicit(&sub.received, memory_order_acquire) >= BENCH_WINDOW) {
+                pipeline_flush(pipeline);
+                while (timings.count - atomic_load_explicit(&sub.received, memory_order_acquire) >= BENCH_WINDOW) {
+                    usleep(10);
+                }
+            }
+            
+            // 接收缓冲区中不足一个最大数据包时，像recv一样一次拷入尽可能多的数据；
+            // 暂存的记录指向接收缓冲区，移动数据之前像一次读取结束时那样成批入队
+            int64_t t0 = now_ns();
+            if (tail - head < SEEDLINK_MAX_PACKET_SIZE && offset < stream_size) {
+                pipeline_flush(pipeline);
+                memmove(recv_buf, recv_buf + head, tail - head);
+                tail -= head;
+                head = 0;
+                size_t n = SEEDLINK_RECV_BUFFER_SIZE - tail;
+                if (n > stream_size - offset) n = stream_size - offset;
+                memcpy(recv_buf + tail, stream + offset, n);
+                tail += n;
+                offset += n;
+            }
+            if (head == tail) break;
+            int packet_length = seedlink_packet_length(recv_buf + head, tail - head);
+            int64_t t1 = now_ns();
+            if (packet_length <= 0 || (size_t)packet_length > tail - head) break;
+            const unsigned char* data = recv_buf + head;
+            head += packet_length;
+            
+            SeedlinkPacket packet;
+            int parsed = seedlink_parse_packet((const char*)data, &packet);
+            int64_t t2 = now_ns();
+            if (parsed < 0) continue;
+            
+            MiniSeedInfo info;
+            int decoded = miniseed_decode(packet.raw, packet.payload_length, &info);
+            int64_t t3 = now_ns();
+            if (decoded < 0) continue;
+            
+            lengths[timings.count] = (uint32_t)packet.payload_length;
+            pipeline_submit(pipeline, &info, packet.raw, packet.payload_length);
+            int64_t t4 = now_ns();
+            
+            record_stage(&timings, BENCH_STAGE_FRAME, t0, t1);
+            record_stage(&timings, BENCH_STAGE_PARSE, t1, t2);
+            record_stage(&timings, BENCH_STAGE_HEADER, t2, t3);
+            record_stage(&timings, BENCH_STAGE_SUBMIT, t3, t4);
+            timings.start[timings.count] = t0;
+            timings.submitted[timings.count] = t4;
+            timings.count++;
+            bytes += packet_length;
+        }
+        pipeline_flush(pipeline);
+    }
+    
+    // 等订阅者收到所有记录（最多等10秒没有进展），存档线程写完剩余记录后结束计时
+    size_t received = 0;
+    for (int idle = 0; idle < 10000; idle++) {
+        size_t now = atomic_load_explicit(&sub.received, memory_order_acquire);
+        if (now == timings.count) break;
+        if (now != received) idle = 0;
+        received = now;
+        usleep(1000);
+    }
+    pipeline_stop(pipeline);
+    double elapsed = (now_ns() - bench_start) / 1e9;
+    
+    server_stop(server);
+    pthread_join(server_thread, NULL);
+    pthread_join(sub_thread, NULL);
+    close(sub.fd);
+    received = atomic_load_explicit(&sub.received, memory_order_acquire);
+    
+    uint64_t archived = 0;
+    for (int i = 0; i < pipeline->shard_count; i++) archived += pipeline->shards[i].records;
+    printf("基准测试结果: %zu 个数据包, %.3f 秒, %.0f 包/秒, %.1f MB/s\n",
+           timings.count, elapsed, timings.count / elapsed, bytes / elapsed / 1e6);
+    printf("  存档 %llu 条, 转发 %llu 条, 回环订阅者收到 %zu 条 (服务器丢弃%llu)\n",
+           (unsigned long long)archived, (unsigned long long)pipeline->broadcast, received,
+           (unsigned long long)server->dropped);
+    if (received < timings.count) {
+        seedlink_log(LOG_WARN, "回环订阅者只收到%zu/%zu条记录，只统计已收到记录的转发延迟", received, timings.count);
+    }
+    // 攒满一批的记录在pipeline_submit返回之前就可能送达，这时转发延迟记为0
+    for (size_t k = 0; k < received; k++) {
+        timings.samples[BENCH_STAGE_DELIVER][k] = clamp_ns(sub.arrival[k] - timings.submitted[k]);
+        timings.total[k] = clamp_ns(sub.arrival[k] - timings.start[k]);
+    }
+    if (received > 0) {
+        printf("  %-12s %10s %10s %10s %10s %10s  (纳秒)\n", "stage", "avg", "p50", "p99", "p999", "max");
+        for (int s = 0; s < BENCH_STAGE_COUNT; s++) {
+            print_stage(stage_names[s], timings.samples[s], s == BENCH_STAGE_DELIVER ? received : timings.count);
+        }
+        print_stage("total", timings.total, received);
+    }
+    
+    pipeline_destroy(pipeline);
+    server_destroy(server);
+    free(recv_buf);
+    free(sub.arrival);
+    free(lengths);
+    timings_free(&timings);
+    free(stream);
+    return 0;
+}
@@ -0,0 +1,34 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "seedlink.h"
+#include "archive.h"
+
+#define BENCH_DEFAULT_LOOPS 10
+#define BENCH_DEFAULT_OUTPUT_DIR "bench_data"
+#define BENCH_WINDOW 1024               // 已提交但回环订阅者尚未收到的记录数上限
+
+// 计时的处理阶段
+typedef enum {
+    BENCH_STAGE_FRAME,      // 数据拷入接收缓冲区并切分数据包（代替recv）
+    BENCH_STAGE_PARSE,      // seedlink_parse_packet
+    BENCH_STAGE_HEADER,     // miniseed_decode
+    BENCH_STAGE_SUBMIT,     // pipeline_submit（攒满一批时入队）
+    BENCH_STAGE_DELIVER,    // 从提交到回环订阅者收到：转发队列、转发线程、客户端队列和socket
+    BENCH_STAGE_COUNT
+} BenchStage;
+
+// 基准测试参数
+typedef struct {
+    int protocol;               // 3：只使用512字节miniSEED 2记录；4：全部记录
+    int loops;                  // 语料重复次数
+    const char* output_dir;     // 保存数据的目录，避免覆盖正常运行的数据文件
+    ArchiveLayout layout;
+} BenchOptions;
+
+// 函数声明
+int bench_run(char* const files[], int file_count, const BenchOptions* options);
+
+#endif
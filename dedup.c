@@ -0,0 +1,79 @@
+#include <stdlib.h>
+#include <string.h>
+#include "dedup.h"
+
+// FNV-1a 哈希
+static uint64_t fnv1a(uint64_t hash, const void* data, size_t len) {
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// 计算记录指纹，0保留给空条目
+static uint64_t record_fingerprint(const MiniSeedInfo* info) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    hash = fnv1a(hash, info->network, strlen(info->network) + 1);
+    hash = fnv1a(hash, info->station, strlen(info->station) + 1);
+    hash = fnv1a(hash, info->location, strlen(info->location) + 1);
+    hash = fnv1a(hash, info->channel, strlen(info->channel) + 1);
+    hash = fnv1a(hash, info->sequence, strlen(info->sequence) + 1);
+    hash = fnv1a(hash, &info->start_time, sizeof(info->start_time));
+    
+    // 打散低位，桶序号取自低位
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash ? hash : 1;
+}
+
+// 创建去重索引，容量向上取整为桶大小乘2的幂
+DedupIndex* dedup_create(size_t capacity) {
+    DedupIndex* index = (DedupIndex*)malloc(sizeof(DedupIndex));
+    if (!index) return NULL;
+    
+    size_t buckets = 1;
+    while (buckets * DEDUP_WAYS < capacity) buckets <<= 1;
+    
+    memset(index, 0, sizeof(DedupIndex));
+    index->entries = (DedupEntry*)calloc(buckets * DEDUP_WAYS, sizeof(DedupEntry));
+    if (!index->entries) {
+        free(index);
+        return NULL;
+    }
+    index->bucket_mask = buckets - 1;
+    
+    return index;
+}
+
+// 检查记录是否已经出现过：是则返回1，否则记录下来并返回0
+int dedup_check(DedupIndex* index, const MiniSeedInfo* info) {
+    uint64_t fp = record_fingerprint(info);
+    DedupEntry* bucket = index->entries + (fp & index->bucket_mask) * DEDUP_WAYS;
+    DedupEntry* victim = bucket;
+    
+    for (int i = 0; i < DEDUP_WAYS; i++) {
+        if (bucket[i].fingerprint == fp) {
+            index->duplicates++;
+            return 1;
+        }
+        if (bucket[i].stamp < victim->stamp) {
+            victim = &bucket[i];
+        }
+    }
+    
+    if (victim->fingerprint) index->evictions++;
+    victim->fingerprint = fp;
+    victim->stamp = ++index->clock;
+    return 0;
+}
+
+// 销毁去重索引
+void dedup_destroy(DedupIndex* index) {
+    if (index) {
+        free(index->entries);
+        free(index);
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "miniseed.h"
+
+#define DEDUP_WAYS 4                    // 每个桶的条目数
+#define DEDUP_DEFAULT_CAPACITY 262144   // 默认条目数（约4MB）
+
+// 记录去重索引
+// 以 NSLC + 记录开始时间 + 记录序列号 的64位指纹为键，组相联哈希表，
+// 容量固定，桶满时淘汰最早插入的条目，每个记录O(1)
+typedef struct {
+    uint64_t fingerprint;   // 0表示空
+    uint64_t stamp;         // 插入顺序，用于淘汰
+} DedupEntry;
+
+typedef struct {
+    DedupEntry* entries;
+    size_t bucket_mask;     // 桶数减一（桶数为2的幂）
+    uint64_t clock;
+    uint64_t duplicates;    // 丢弃的重复记录数
+    uint64_t evictions;     // 被淘汰的条目数
+} DedupIndex;
+
+// 函数声明
+DedupIndex* dedup_create(size_t capacity);
+int dedup_check(DedupIndex* index, const MiniSeedInfo* info);
+void dedup_destroy(DedupIndex* index);
+
+#endif
@@ -0,0 +1,324 @@
+#include "ingest.h"
+
+// 单调时钟毫秒数
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// 根据连接状态更新epoll关注的事件
+static int update_events(IngestEngine* engine, SeedLink* sl, int op) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | (seedlink_wants_write(sl) ? EPOLLOUT : 0);
+    ev.data.ptr = sl;
+    
+    if (epoll_ctl(engine->epoll_fd, op, sl->sockfd, &ev) < 0) {
+        seedlink_log(LOG_ERROR, "epoll_ctl失败: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+// 按指数退避安排下次重连
+static void schedule_reconnect(SeedLink* sl, int64_t now) {
+    sl->reconnect_delay_ms = sl->reconnect_delay_ms ? sl->reconnect_delay_ms * 2 : INGEST_RECONNECT_MIN_MS;
+    if (sl->reconnect_delay_ms > INGEST_RECONNECT_MAX_MS) sl->reconnect_delay_ms = INGEST_RECONNECT_MAX_MS;
+    sl->reconnect_at_ms = now + sl->reconnect_delay_ms;
+}
+
+// 发起连接并加入epoll，失败时安排下次重连
+static void start_connection(IngestEngine* engine, SeedLink* sl) {
+    int64_t now = now_ms();
+    
+    seedlink_log(LOG_INFO, "[%s.%s] 正在连接到服务器 %s:%d...",
+                 sl->network, sl->station, sl->server_name, sl->port);
+    if (seedlink_connect_async(sl) == 0) {
+        if (update_events(engine, sl, EPOLL_CTL_ADD) == 0) {
+            sl->connected_at_ms = now;
+            engine->active_count++;
+            return;
+        }
+        seedlink_close(sl);
+    }
+    
+    sl->state = SL_STATE_DISCONNECTED;
+    schedule_reconnect(sl, now);
+}
+
+// 关闭一个连接并安排重连
+// 连接已稳定运行时立即重连并从最后的序列号续传，否则按指数退避
+static void close_connection(IngestEngine* engine, SeedLink* sl) {
+    if (sl->sockfd < 0) return;
+    
+    int64_t now = now_ms();
+    epoll_ctl(engine->epoll_fd, EPOLL_CTL_DEL, sl->sockfd, NULL);
+    seedlink_close(sl);
+    sl->state = SL_STATE_DISCONNECTED;
+    engine->active_count--;
+    
+    if (now - sl->connected_at_ms >= INGEST_STABLE_MS) {
+        sl->reconnect_delay_ms = 0;
+        sl->reconnect_at_ms = now;
+    } else {
+        schedule_reconnect(sl, now);
+    }
+    
+    seedlink_log(LOG_WARN, "[%s.%s] 连接已关闭，%d毫秒后重连 (最后序列号: %lld)",
+                 sl->network, sl->station, sl->reconnect_delay_ms, (long long)sl->last_sequence);
+}
+
+// 重连到期的连接，返回距下一次重连的毫秒数（没有待重连的连接时为-1）
+static int reconnect_due(IngestEngine* engine) {
+    int64_t now = now_ms();
+    int64_t next = -1;
+    
+    for (int i = 0; i < engine->connection_count; i++) {
+        SeedLink* sl = engine->connections[i];
+        if (sl->state != SL_STATE_DISCONNECTED) continue;
+        
+        if (sl->reconnect_at_ms <= now) {
+            start_connection(engine, sl);
+        }
+        if (sl->state == SL_STATE_DISCONNECTED &&
+            (next < 0 || sl->reconnect_at_ms - now < next)) {
+            next = sl->reconnect_at_ms - now;
+        }
+    }
+    
+    return (int)next;
+}
+
+// 创建接收引擎
+IngestEngine* ingest_create(SeedLinkPacketHandler handler, void* user) {
+    IngestEngine* engine = (IngestEngine*)malloc(sizeof(IngestEngine));
+    if (!engine) return NULL;
+    
+    memset(engine, 0, sizeof(IngestEngine));
+    engine->handler = handler;
+    engine->user = user;
+    engine->protocol = 3;
+    engine->pipelined = 1;
+    
+    engine->epoll_fd = epoll_create1(0);
+    if (engine->epoll_fd < 0) {
+        seedlink_log(LOG_ERROR, "创建epoll失败: %s", strerror(errno));
+        free(engine);
+        return NULL;
+    }
+    
+    return engine;
+}
+
+// 添加一个台站连接，连接在ingest_run中发起。
+// 服务器地址在这里解析一次，同一服务器的连接共用解析结果，接收循环中重连时不再解析
+int ingest_add_station(IngestEngine* engine, const char* server, int port,
+                       const char* network, const char* station, const char* location,
+                       const char* channels[], int channel_count) {
+    if (engine->connection_count == engine->connection_capacity) {
+        int capacity = engine->connection_capacity ? engine->connection_capacity * 2 : 16;
+        SeedLink** conns = (SeedLink**)realloc(engine->connections, capacity * sizeof(SeedLink*));
+        if (!conns) return -1;
+        engine->connections = conns;
+        engine->connection_capacity = capacity;
+    }
+    
+    SeedLink* sl = seedlink_create(server, port);
+    if (!sl) return -1;
+    for (int i = 0; i < engine->connection_count && sl->addr_len == 0; i++) {
+        const SeedLink* other = engine->connections[i];
+        if (other->port == port && strcmp(other->server_name, sl->server_name) == 0) {
+            sl->addr = other->addr;
+            sl->addr_len = other->addr_len;
+        }
+    }
+    if (sl->addr_len == 0 && seedlink_resolve(sl) < 0) {
+        seedlink_destroy(sl);
+        return -1;
+    }
+    sl->protocol = engine->protocol;
+    sl->pipelined = engine->pipelined;
+    
+    if (seedlink_set_station(sl, network, station, location, channels, channel_count) < 0) {
+        seedlink_destroy(sl);
+        return -1;
+    }
+    
+    engine->connections[engine->connection_count++] = sl;
+    return 0;
+}
+
+// 从状态文件恢复各连接的序列号，每行格式：server port NET STA sequence
+// 需在添加台站之后调用；文件不存在时视为首次运行
+int ingest_load_state(IngestEngine* engine, const char* path) {
+    strncpy(engine->state_path, path, sizeof(engine->state_path)-1);
+    
+    FILE* fp = fopen(path, "r");
+    if (!fp) {
+        if (errno == ENOENT) return 0;
+        seedlink_log(LOG_ERROR, "无法打开状态文件 %s: %s", path, strerror(errno));
+        return -1;
+    }
+    
+    char server[256], network[8], station[8];
+    int port, restored = 0;
+    long long sequence;
+    while (fscanf(fp, "%255s %d %7s %7s %lld", server, &port, network, station, &sequence) == 5) {
+        for (int i = 0; i < engine->connection_count; i++) {
+            SeedLink* sl = engine->connections[i];
+            if (sl->port == port && strcmp(sl->server_name, server) == 0 &&
+                strcmp(sl->network, network) == 0 && strcmp(sl->station, station) == 0) {
+                sl->last_sequence = sequence;
+                sl->saved_sequence = sequence;
+                restored++;
+            }
+        }
+    }
+    
+    fclose(fp);
+    seedlink_log(LOG_INFO, "从状态文件 %s 恢复了 %d 个连接的序列号", path, restored);
+    return restored;
+}
+
+// 保存各连接已处理完的序列号：先写临时文件再rename，保证文件始终完整
+int ingest_save_state(IngestEngine* engine) {
+    if (!engine->state_path[0]) return 0;
+    
+    char tmp_path[sizeof(engine->state_path) + 8];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", engine->state_path);
+    
+    FILE* fp = fopen(tmp_path, "w");
+    if (!fp) {
+        seedlink_log(LOG_ERROR, "无法写入状态文件 %s: %s", tmp_path, strerror(errno));
+        return -1;
+    }
+    
+    for (int i = 0; i < engine->connection_count; i++) {
+        SeedLink* sl = engine->connections[i];
+        if (sl->saved_sequence < 0) continue;
+        fprintf(fp, "%s %d %s %s %lld\n", sl->server_name, sl->port,
+                sl->network, sl->station, (long long)sl->saved_sequence);
+    }
+    
+    if (fclose(fp) != 0 || rename(tmp_path, engine->state_path) < 0) {
+        seedlink_log(LOG_ERROR, "保存状态文件失败: %s", strerror(errno));
+        return -1;
+    }
+    
+    engine->state_saved_at_ms = now_ms();
+    return 0;
+}
+
+// 设置检查点回调，数据包回调异步处理记录时使用（如交给存档线程），应在ingest_run之前调用
+void ingest_set_checkpoint(IngestEngine* engine, IngestCheckpointMark mark, IngestCheckpointDone done) {
+    engine->checkpoint_mark = mark;
+    engine->checkpoint_done = done;
+}
+
+// 调用者确认收到的记录都已处理完（如流水线已停止）后保存最后收到的序列号
+int ingest_commit_state(IngestEngine* engine) {
+    for (int i = 0; i < engine->connection_count; i++) {
+        engine->connections[i]->saved_sequence = engine->connections[i]->last_sequence;
+    }
+    engine->checkpoint_pending = 0;
+    return ingest_save_state(engine);
+}
+
+// 定期保存状态：先记下各连接收到的序列号作为检查点，此前的记录都处理完后才保存这些序列号，
+// 状态文件中的序列号之前的记录重启后不会丢失。没有设置检查点回调时收到即视为处理完
+static void update_state(IngestEngine* engine) {
+    if (engine->checkpoint_pending) {
+        if (!engine->checkpoint_done(engine->user)) return;
+        for (int i = 0; i < engine->connection_count; i++) {
+            engine->connections[i]->saved_sequence = engine->connections[i]->checkpoint_sequence;
+        }
+        engine->checkpoint_pending = 0;
+        ingest_save_state(engine);
+        return;
+    }
+    if (now_ms() - engine->state_saved_at_ms < INGEST_STATE_INTERVAL_MS) return;
+    
+    for (int i = 0; i < engine->connection_count; i++) {
+        SeedLink* sl = engine->connections[i];
+        sl->checkpoint_sequence = sl->last_sequence;
+        if (!engine->checkpoint_mark) sl->saved_sequence = sl->last_sequence;
+    }
+    if (!engine->checkpoint_mark) {
+        ingest_save_state(engine);
+        return;
+    }
+    engine->checkpoint_mark(engine->user);
+    engine->checkpoint_pending = 1;
+    engine->state_saved_at_ms = now_ms();
+}
+
+// 事件循环：直到调用ingest_stop，断开的连接自动重连
+int ingest_run(IngestEngine* engine) {
+    struct epoll_event events[INGEST_MAX_EVENTS];
+    
+    engine->running = 1;
+    engine->state_saved_at_ms = now_ms();
+    for (int i = 0; i < engine->connection_count; i++) {
+        start_connection(engine, engine->connections[i]);
+    }
+    
+    while (engine->running) {
+        // 等待时间不超过下一次重连和状态保存的时间，等待检查点确认时定期检查
+        int timeout = reconnect_due(engine);
+        int64_t save_in = engine->checkpoint_pending ? INGEST_CHECKPOINT_POLL_MS :
+                          engine->state_saved_at_ms + INGEST_STATE_INTERVAL_MS - now_ms();
+        if (timeout < 0 || timeout > save_in) timeout = save_in > 0 ? (int)save_in : 0;
+        
+        int n = epoll_wait(engine->epoll_fd, events, INGEST_MAX_EVENTS, timeout);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            seedlink_log(LOG_ERROR, "epoll_wait失败: %s", strerror(errno));
+            break;
+        }
+        
+        for (int i = 0; i < n; i++) {
+            SeedLink* sl = (SeedLink*)events[i].data.ptr;
+            if (sl->sockfd < 0) continue;
+            
+            uint32_t ev = events[i].events;
+            int readable = (ev & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0;
+            int writable = (ev & (EPOLLOUT | EPOLLERR)) != 0;
+            int wanted_write = seedlink_wants_write(sl);
+            
+            if (seedlink_handle_io(sl, readable, writable, engine->handler, engine->user) < 0) {
+                close_connection(engine, sl);
+                continue;
+            }
+            
+            if (seedlink_wants_write(sl) != wanted_write &&
+                update_events(engine, sl, EPOLL_CTL_MOD) < 0) {
+                close_connection(engine, sl);
+            }
+        }
+        
+        update_state(engine);
+    }
+    
+    // 退出前保存已确认的序列号；收到的其余记录由调用者处理完后用ingest_commit_state保存
+    if (!engine->checkpoint_mark) ingest_commit_state(engine);
+    else ingest_save_state(engine);
+    return 0;
+}
+
+// 请求停止事件循环（可在信号处理函数中调用）
+void ingest_stop(IngestEngine* engine) {
+    engine->running = 0;
+}
+
+// 销毁接收引擎和所有连接
+void ingest_destroy(IngestEngine* engine) {
+    if (!engine) return;
+    
+    for (int i = 0; i < engine->connection_count; i++) {
+        seedlink_destroy(engine->connections[i]);
+    }
+    free(engine->connections);
+    close(engine->epoll_fd);
+    free(engine);
+}
@@ -0,0 +1,58 @@
+#ifndef INGEST_H
+#define INGEST_H
+
+#include <sys/epoll.h>
+#include "seedlink.h"
+
+#define INGEST_MAX_EVENTS 64
+#define INGEST_RECONNECT_MIN_MS 1000     // 连续重连失败时的初始退避时间
+#define INGEST_RECONNECT_MAX_MS 30000    // 最大退避时间
+#define INGEST_STABLE_MS 10000           // 连接保持超过该时间后断开可立即重连
+#define INGEST_STATE_INTERVAL_MS 10000   // 状态文件保存间隔
+#define INGEST_CHECKPOINT_POLL_MS 100    // 等待检查点确认时的检查间隔
+
+// 检查点回调：mark记下此前交给数据包回调的所有记录，done返回这些记录是否都已处理完
+typedef void (*IngestCheckpointMark)(void* user);
+typedef int (*IngestCheckpointDone)(void* user);
+
+// 多台站接收引擎：单个epoll循环管理所有SeedLink连接
+typedef struct {
+    int epoll_fd;
+    SeedLink** connections;     // 所有连接（动态数组）
+    int connection_count;
+    int connection_capacity;
+    int active_count;           // 当前已建立或正在建立的连接数
+    int protocol;               // 新连接使用的SeedLink协议版本
+    int pipelined;              // 新连接是否批量发送协商命令
+    volatile int running;
+    SeedLinkPacketHandler handler;
+    void* user;
+
+    // 序列号状态文件：记录每个连接已处理完的序列号，重启后续传。
+    // 设置了检查点回调时，保存前先记下各连接收到的序列号，等回调确认此前的记录都已处理完再写入
+    char state_path[256];
+    int64_t state_saved_at_ms;
+    IngestCheckpointMark checkpoint_mark;
+    IngestCheckpointDone checkpoint_done;
+    int checkpoint_pending;
+} IngestEngine;
+
+// 函数声明
+IngestEngine* ingest_create(SeedLinkPacketHandler handler, void* user);
+int ingest_add_station(IngestEngine* engine,
+                       const char* server,
+                       int port,
+                       const char* network,
+                       const char* station,
+                       const char* location,
+                       const char* channels[],
+                       int channel_count);
+int ingest_load_state(IngestEngine* engine, const char* path);
+int ingest_save_state(IngestEngine* engine);
+void ingest_set_checkpoint(IngestEngine* engine, IngestCheckpointMark mark, IngestCheckpointDone done);
+int ingest_commit_state(IngestEngine* engine);
+int ingest_run(IngestEngine* engine);
+void ingest_stop(IngestEngine* engine);
+void ingest_destroy(IngestEngine* engine);
+
+#endif
@@ -0,0 +1,280 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "logger.h"
+
+volatile int g_log_level = LOG_INFO;
+
+// 一条日志记录：由写日志的线程格式化，后台线程加时间戳输出
+typedef struct {
+    time_t sec;
+    uint8_t level;
+    uint16_t length;
+    char message[LOG_MESSAGE_SIZE];
+} LogRecord;
+
+// 每个线程一个单生产者/单消费者环形缓冲区，写日志时无锁
+typedef struct LogRing {
+    _Atomic size_t head;        // 后台线程读取位置
+    _Atomic size_t tail;        // 写日志线程写入位置
+    _Atomic uint64_t dropped;   // 缓冲区满时丢弃的条数
+    _Atomic int orphaned;       // 所属线程已退出，读完后释放
+    struct LogRing* next;
+    LogRecord records[LOG_RING_SIZE];
+} LogRing;
+
+static LogRing* g_rings = NULL;                 // 所有线程的环形缓冲区
+static pthread_mutex_t g_rings_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t g_ring_key;
+static pthread_once_t g_key_once = PTHREAD_ONCE_INIT;
+static __thread LogRing* t_ring = NULL;
+
+static pthread_t g_flusher;
+static _Atomic int g_running = 0;
+
+static const char* level_names[] = {"DEBUG", "INFO", "WARN", "ERROR"};
+
+// 线程退出时标记其缓冲区，由后台线程读完后释放
+static void ring_release(void* arg) {
+    atomic_store_explicit(&((LogRing*)arg)->orphaned, 1, memory_order_release);
+}
+
+static void make_key(void) {
+    pthread_key_create(&g_ring_key, ring_release);
+}
+
+// 取得当前线程的环形缓冲区，首次使用时创建并登记
+static LogRing* thread_ring(void) {
+    if (t_ring) return t_ring;
+    
+    LogRing* ring = (LogRing*)calloc(1, sizeof(LogRing));
+    if (!ring) return NULL;
+    
+    pthread_once(&g_key_once, make_key);
+    pthread_setspecific(g_ring_key, ring);
+    
+    pthread_mutex_lock(&g_rings_mutex);
+    ring->next = g_rings;
+    g_rings = ring;
+    pthread_mutex_unlock(&g_rings_mutex);
+    
+    t_ring = ring;
+    return ring;
+}
+
+// 格式化时间戳，同一秒内复用上次的结果
+static const char* format_timestamp(time_t sec) {
+    static time_t cached_sec = -1;
+    static char cached[20];
+    
+    if (sec != cached_sec) {
+        struct tm timeinfo;
+        localtime_r(&sec, &timeinfo);
+        strftime(cached, sizeof(cached), "%Y-%m-%d %H:%M:%S", &timeinfo);
+        cached_sec = sec;
+    }
+    return cached;
+}
+
+// 写出缓冲区内容到stderr
+static void write_all(const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(STDERR_FILENO, data, len);
+        if (n <= 0) return;
+        data += n;
+        len -= n;
+    }
+}
+
+// 追加一行日志到合并写缓冲区，缓冲区满时先写出
+static void append_line(char* out, size_t* out_len, time_t sec, int level,
+                        const char* message, size_t length) {
+    char prefix[48];
+    int prefix_len = snprintf(prefix, sizeof(prefix), "[%s][%s] ",
+                              format_timestamp(sec), level_names[level]);
+    
+    if (*out_len + prefix_len + length + 1 > LOG_FLUSH_BUFFER_SIZE) {
+        write_all(out, *out_len);
+        *out_len = 0;
+    }
+    memcpy(out + *out_len, prefix, prefix_len);
+    *out_len += prefix_len;
+    memcpy(out + *out_len, message, length);
+    *out_len += length;
+    out[(*out_len)++] = '\n';
+}
+
+// 读出所有缓冲区中的日志并一次写出，返回处理的条数
+static size_t drain_rings(char* out) {
+    size_t out_len = 0, count = 0;
+    
+    pthread_mutex_lock(&g_rings_mutex);
+    LogRing** link = &g_rings;
+    while (*link) {
+        LogRing* ring = *link;
+        int orphaned = atomic_load_explicit(&ring->orphaned, memory_order_acquire);
+        size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        
+        for (; head != tail; head++, count++) {
+            LogRecord* rec = &ring->records[head & (LOG_RING_SIZE - 1)];
+            append_line(out, &out_len, rec->sec, rec->level, rec->message, rec->length);
+        }
+        atomic_store_explicit(&ring->head, head, memory_order_release);
+        
+        uint64_t dropped = atomic_exchange_explicit(&ring->dropped, 0, memory_order_relaxed);
+        if (dropped > 0) {
+            char msg[64];
+            int len = snprintf(msg, sizeof(msg), "日志缓冲区已满，丢弃了%llu条日志",
+                               (unsigned long long)dropped);
+            append_line(out, &out_len, time(NULL), LOG_WARN, msg, len);
+        }
+        
+        if (orphaned) {
+            *link = ring->next;
+            free(ring);
+        } else {
+            link = &ring->next;
+        }
+    }
+    pthread_mutex_unlock(&g_rings_mutex);
+    
+    write_all(out, out_len);
+    return count;
+}
+
+// 后台写日志线程
+static void* flusher_thread(void* arg) {
+    char* out = (char*)arg;
+    struct timespec idle = {0, LOG_FLUSH_INTERVAL_MS * 1000000L};
+    
+    while (atomic_load_explicit(&g_running, memory_order_acquire)) {
+        if (drain_rings(out) == 0) {
+            nanosleep(&idle, NULL);
+        }
+    }
+    
+    drain_rings(out);
+    free(out);
+    return NULL;
+}
+
+// 格式化到固定大小的缓冲区，截断时退到UTF-8字符边界，不输出半个汉字；返回正文长度
+static int format_message(char* message, size_t size, const char* format, va_list args) {
+    int len = vsnprintf(message, size, format, args);
+    if (len < 0) return 0;
+    if (len < (int)size) return len;
+    
+    len = (int)size - 1;
+    int start = len;
+    while (start > 0 && ((unsigned char)message[start - 1] & 0xC0) == 0x80) start--;
+    if (start > 0) {
+        unsigned char lead = (unsigned char)message[start - 1];
+        int need = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 1;
+        if (start - 1 + need > len) len = start - 1;
+    }
+    message[len] = '\0';
+    return len;
+}
+
+// 不经过后台线程直接输出一条日志
+static void write_direct(LogLevel level, const char* format, va_list args) {
+    char message[LOG_MESSAGE_SIZE];
+    format_message(message, sizeof(message), format, args);
+    
+    time_t now = time(NULL);
+    struct tm timeinfo;
+    char timestamp[20];
+    localtime_r(&now, &timeinfo);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &timeinfo);
+    fprintf(stderr, "[%s][%s] %s\n", timestamp, level_names[level], message);
+}
+
+// 缓冲区满时等待后台线程腾出空位，最多LOG_ERROR_WAIT_MS毫秒
+static int wait_for_space(LogRing* ring, size_t tail) {
+    struct timespec pause = {0, 1000000L};
+    for (int i = 0; i < LOG_ERROR_WAIT_MS; i++) {
+        nanosleep(&pause, NULL);
+        if (tail - atomic_load_explicit(&ring->head, memory_order_acquire) < LOG_RING_SIZE) return 1;
+    }
+    return 0;
+}
+
+// 写一条日志：后台线程运行时写入本线程的环形缓冲区，否则直接输出。
+// 缓冲区满时丢弃低级别的日志；ERROR日志先等后台线程腾出空位（保持本线程日志的顺序），超时则直接输出
+void log_write(LogLevel level, const char* format, ...) {
+    va_list args;
+    LogRing* ring = atomic_load_explicit(&g_running, memory_order_acquire) ? thread_ring() : NULL;
+    
+    if (!ring) {
+        va_start(args, format);
+        write_direct(level, format, args);
+        va_end(args);
+        return;
+    }
+    
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (tail - head >= LOG_RING_SIZE) {
+        if (level < LOG_ERROR) {
+            atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+            return;
+        }
+        if (!wait_for_space(ring, tail)) {
+            va_start(args, format);
+            write_direct(level, format, args);
+            va_end(args);
+            return;
+        }
+    }
+    
+    // 直接格式化到环形缓冲区的槽位中
+    LogRecord* rec = &ring->records[tail & (LOG_RING_SIZE - 1)];
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    rec->sec = ts.tv_sec;
+    rec->level = level;
+    
+    va_start(args, format);
+    int len = format_message(rec->message, sizeof(rec->message), format, args);
+    va_end(args);
+    
+    // 去掉末尾的换行，输出时统一添加
+    while (len > 0 && (rec->message[len-1] == '\n' || rec->message[len-1] == '\r')) len--;
+    rec->length = (uint16_t)len;
+    
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+// 解析日志级别名称
+int log_parse_level(const char* name) {
+    for (int i = LOG_DEBUG; i <= LOG_ERROR; i++) {
+        if (strcasecmp(name, level_names[i]) == 0) return i;
+    }
+    return -1;
+}
+
+// 启动后台写日志线程
+int log_start(void) {
+    char* out = (char*)malloc(LOG_FLUSH_BUFFER_SIZE);
+    if (!out) return -1;
+    
+    atomic_store(&g_running, 1);
+    if (pthread_create(&g_flusher, NULL, flusher_thread, out) != 0) {
+        atomic_store(&g_running, 0);
+        free(out);
+        return -1;
+    }
+    return 0;
+}
+
+// 停止后台线程并写出剩余日志，之后的日志直接输出
+void log_shutdown(void) {
+    if (!atomic_exchange(&g_running, 0)) return;
+    pthread_join(g_flusher, NULL);
+}
@@ -0,0 +1,38 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <stdint.h>
+#include <time.h>
+
+#define LOG_RING_SIZE 512           // 每个线程的日志环形缓冲区条目数（2的幂）
+#define LOG_MESSAGE_SIZE 240        // 单条日志正文的最大长度
+#define LOG_FLUSH_BUFFER_SIZE (64 * 1024)  // 后台线程的合并写缓冲区
+#define LOG_FLUSH_INTERVAL_MS 10    // 没有日志时后台线程的轮询间隔
+#define LOG_ERROR_WAIT_MS 100       // 缓冲区满时ERROR日志等待后台线程腾出空位的最长时间，超时后直接输出
+
+// 日志级别
+typedef enum {
+    LOG_DEBUG,
+    LOG_INFO,
+    LOG_WARN,
+    LOG_ERROR
+} LogLevel;
+
+// 当前日志级别，低于该级别的日志在格式化之前就被丢弃
+extern volatile int g_log_level;
+
+#define log_enabled(level) ((int)(level) >= g_log_level)
+
+// 先检查级别再格式化，关闭的级别只有一次比较的开销
+#define seedlink_log(level, ...) \
+    do { \
+        if (log_enabled(level)) log_write((level), __VA_ARGS__); \
+    } while (0)
+
+// 函数声明
+void log_write(LogLevel level, const char* format, ...) __attribute__((format(printf, 2, 3)));
+int log_parse_level(const char* name);
+int log_start(void);
+void log_shutdown(void);
+
+#endif
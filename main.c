@@ -1,12 +1,381 @@
 #include "seedlink.h"
 #include "miniseed.h"
 #include "server.h"
+#include "ingest.h"
+#include "dedup.h"
+#include "bench.h"
+#include "pipeline.h"
+#include "archive_index.h"
+#include <signal.h>
+#include <sys/resource.h>
 
-int main()
+#define MAX_STATION_LINE 512
+#define MAX_UPSTREAMS 4
+#define MAX_BENCH_FILES 16
+#define DEFAULT_STATE_FILE "seedlink.state"
+
+// 上游SeedLink服务器
+typedef struct {
+    char host[256];
+    int port;
+} Upstream;
+
+// 数据包处理所需的上下文
+typedef struct {
+    Pipeline* pipeline;
+    DedupIndex* dedup;      // 多个上游时去除重复记录，单个上游时为NULL
+} IngestContext;
+
+static IngestEngine* g_engine = NULL;
+
+// SIGINT/SIGTERM：停止接收循环，退出前保存序列号
+static void handle_signal(int sig)
+{
+    (void)sig;
+    if (g_engine) ingest_stop(g_engine);
+}
+
+// 数据包处理：解析后交给存档和转发线程，接收线程不做磁盘写入和客户端发送
+static void handle_packet(SeedLink* sl, const SeedlinkPacket* packet, void* user)
+{
+    IngestContext* ctx = (IngestContext*)user;
+    MiniSeedInfo info;
+
+    (void)sl;
+
+    // 一次读取的数据包处理完，成批入队
+    if (!packet) {
+        pipeline_flush(ctx->pipeline);
+        return;
+    }
+
+    // 解析miniSEED头，多个上游时只保留先到达的一份
+    if (miniseed_decode(packet->raw, packet->payload_length, &info) == 0 &&
+        !(ctx->dedup && dedup_check(ctx->dedup, &info)))
+    {
+        if (packet->mseed && log_enabled(LOG_DEBUG)) {
+            miniseed_parse_header(packet->mseed);
+        }
+
+        // 按实际负载长度暂存，读取结束时成批入队，由存档线程保存、转发线程发送给客户端
+        pipeline_submit(ctx->pipeline, &info, packet->raw, packet->payload_length);
+    }
+}
+
+// 状态文件的检查点：记下已交给流水线的记录，等存档线程写完后才保存对应的序列号；
+// 同时按间隔输出各队列的统计
+static void checkpoint_mark(void* user)
 {
+    IngestContext* ctx = (IngestContext*)user;
+    pipeline_checkpoint(ctx->pipeline);
+    pipeline_report(ctx->pipeline);
+}
+
+static int checkpoint_done(void* user)
+{
+    return pipeline_checkpoint_done(((IngestContext*)user)->pipeline);
+}
+
+// 解析 host:port 格式的服务器地址
+static int parse_server_address(const char* arg, char* host, size_t size, int* port)
+{
+    const char* colon = strrchr(arg, ':');
+    size_t len = colon ? (size_t)(colon - arg) : strlen(arg);
+
+    if (len == 0 || len >= size) return -1;
+    memcpy(host, arg, len);
+    host[len] = '\0';
+    *port = colon ? atoi(colon + 1) : SEEDLINK_PORT;
+
+    return *port > 0 ? 0 : -1;
+}
+
+// 为每个上游服务器添加同一个台站
+static int add_station(IngestEngine* engine, const Upstream* upstreams, int upstream_count,
+                       const char* network, const char* station, const char* location,
+                       const char* channels[], int channel_count)
+{
+    int added = 0;
+    for (int i = 0; i < upstream_count; i++) {
+        if (ingest_add_station(engine, upstreams[i].host, upstreams[i].port,
+                               network, station, location, channels, channel_count) == 0) {
+            added++;
+        }
+    }
+    return added;
+}
+
+// 从台站列表文件添加台站，每行格式：NET STA LOC CHA [CHA...]，位置码为空时写 "--"
+static int load_station_file(IngestEngine* engine, const char* path,
+                             const Upstream* upstreams, int upstream_count)
+{
+    FILE* fp = fopen(path, "r");
+    if (!fp) {
+        seedlink_log(LOG_ERROR, "无法打开台站列表 %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    char line[MAX_STATION_LINE];
+    int line_no = 0, added = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        line_no++;
+        char* hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+
+        char* fields[3 + SEEDLINK_MAX_CHANNELS];
+        int count = 0;
+        for (char* tok = strtok(line, " \t\r\n"); tok && count < 3 + SEEDLINK_MAX_CHANNELS;
+             tok = strtok(NULL, " \t\r\n")) {
+            fields[count++] = tok;
+        }
+        if (count == 0) continue;
+        if (count < 4) {
+            seedlink_log(LOG_WARN, "台站列表 %s:%d 格式错误，已忽略", path, line_no);
+            continue;
+        }
+
+        const char* location = strcmp(fields[2], "--") == 0 ? "" : fields[2];
+        added += add_station(engine, upstreams, upstream_count, fields[0], fields[1], location,
+                             (const char**)&fields[3], count - 3);
+    }
+
+    fclose(fp);
+    seedlink_log(LOG_INFO, "从 %s 加载了 %d 个台站连接", path, added);
+    return added;
+}
+
+static void usage(const char* prog)
+{
+    fprintf(stderr, "用法: %s [-s host:port]... [-c stations.conf] [-p 3|4] [-S] [-f state_file]"
+                    " [-d dedup_entries] [-l debug|info|warn|error]\n", prog);
+    fprintf(stderr, "  [-o archive_dir] [-L flat|sds] [-U] [-P] [-D none|close|interval:ms|records:n] [-W archive_threads] [-O max_open_fds] [-Q queue_slots] [-A archive_policy] [-F fanout_policy]"
+                    "  (策略: block|drop-oldest|drop-newest|spill)\n");
+    fprintf(stderr, "  [-C drop-oldest|disconnect|pause[:records]]  (下游客户端发送队列满时的策略)\n");
+    fprintf(stderr, "  [-H minutes]  (每个通道在内存中保留最近的数据，客户端可用SINCE命令回放)\n");
+    fprintf(stderr, "基准测试: %s -b file.mseed [-b file.mseed]... [-n loops] [-p 3|4]\n", prog);
+    fprintf(stderr, "按时间提取: %s -x archive_file -t start,end > out.mseed"
+                    "  (时间: YYYY-MM-DDTHH:MM:SS[.ffffff] 或 YYYY,DDD,HH:MM:SS)\n", prog);
+}
+
+// 按索引提取存档文件中与时间窗口重叠的记录，写到标准输出
+static int extract_records(const char* path, const char* window)
+{
+    char start_text[64];
+    const char* comma = window ? strchr(window, ',') : NULL;
+    int64_t start_time, end_time;
+
+    // 年积日格式本身含有两个逗号，两个时间之间是第三个逗号
+    if (comma && memchr(window, '-', comma - window) == NULL) {
+        comma = strchr(comma + 1, ',');
+        if (comma) comma = strchr(comma + 1, ',');
+    }
+    if (!comma || (size_t)(comma - window) >= sizeof(start_text)) {
+        seedlink_log(LOG_ERROR, "无效的时间窗口: %s", window ? window : "");
+        return -1;
+    }
+    memcpy(start_text, window, comma - window);
+    start_text[comma - window] = '\0';
+    if (miniseed_parse_time(start_text, &start_time) < 0 || miniseed_parse_time(comma + 1, &end_time) < 0) {
+        seedlink_log(LOG_ERROR, "无效的时间窗口: %s", window);
+        return -1;
+    }
+
+    int count = archive_index_extract(path, start_time, end_time, stdout);
+    if (count < 0) return -1;
+    fflush(stdout);
+    seedlink_log(LOG_INFO, "从 %s 提取了%d条记录", path, count);
+    return 0;
+}
+
+// 把打开文件数的软限制提高到硬限制：存档文件及其索引、下游客户端连接都占用文件描述符，
+// 默认的1024很快就会用完
+static void raise_fd_limit(void)
+{
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) < 0) return;
+    if (limit.rlim_cur == limit.rlim_max) return;
+    
+    rlim_t previous = limit.rlim_cur;
+    limit.rlim_cur = limit.rlim_max;
+    if (setrlimit(RLIMIT_NOFILE, &limit) < 0) {
+        seedlink_log(LOG_WARN, "无法提高打开文件数限制: %s", strerror(errno));
+        return;
+    }
+    seedlink_log(LOG_INFO, "打开文件数限制: %llu -> %llu",
+                 (unsigned long long)previous, (unsigned long long)limit.rlim_cur);
+}
+
+int main(int argc, char* argv[])
+{
+    Upstream upstreams[MAX_UPSTREAMS];
+    int upstream_count = 0;
+    size_t dedup_capacity = DEDUP_DEFAULT_CAPACITY;
+    int protocol = 3;
+    int pipelined = 1;
+    const char* station_file = NULL;
+    const char* state_file = DEFAULT_STATE_FILE;
+    char* bench_files[MAX_BENCH_FILES];
+    int bench_file_count = 0;
+    int bench_loops = BENCH_DEFAULT_LOOPS;
+    const char* extract_file = NULL;
+    const char* extract_window = NULL;
+    PipelineOptions pipeline_options;
+    pipeline_default_options(&pipeline_options);
+    ServerPolicy client_policy = SERVER_POLICY_DROP_OLDEST;
+    uint32_t client_queue = SERVER_CLIENT_QUEUE;
+    int history_minutes = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:c:p:Sf:d:l:b:n:x:t:Q:A:F:W:O:o:L:UPD:C:H:h")) != -1) {
+        switch (opt) {
+            case 's':
+                // 可指定多个上游，同一台站同时从每个上游接收
+                if (upstream_count == MAX_UPSTREAMS) {
+                    seedlink_log(LOG_ERROR, "最多支持%d个上游服务器", MAX_UPSTREAMS);
+                    return 1;
+                }
+                if (parse_server_address(optarg, upstreams[upstream_count].host,
+                                         sizeof(upstreams[upstream_count].host),
+                                         &upstreams[upstream_count].port) < 0) {
+                    seedlink_log(LOG_ERROR, "无效的服务器地址: %s", optarg);
+                    return 1;
+                }
+                upstream_count++;
+                break;
+            case 'd':
+                dedup_capacity = strtoul(optarg, NULL, 10);
+                break;
+            case 'l':
+                if (log_parse_level(optarg) < 0) {
+                    seedlink_log(LOG_ERROR, "无效的日志级别: %s", optarg);
+                    return 1;
+                }
+                g_log_level = log_parse_level(optarg);
+                break;
+            case 'c':
+                station_file = optarg;
+                break;
+            case 'p':
+                protocol = atoi(optarg);
+                if (protocol != 3 && protocol != 4) {
+                    seedlink_log(LOG_ERROR, "不支持的协议版本: %s", optarg);
+                    return 1;
+                }
+                break;
+            case 'S':
+                pipelined = 0;
+                break;
+            case 'f':
+                state_file = optarg;
+                break;
+            case 'b':
+                if (bench_file_count == MAX_BENCH_FILES) {
+                    seedlink_log(LOG_ERROR, "最多支持%d个基准测试文件", MAX_BENCH_FILES);
+                    return 1;
+                }
+                bench_files[bench_file_count++] = optarg;
+                break;
+            case 'n':
+                bench_loops = atoi(optarg);
+                break;
+            case 'x':
+                extract_file = optarg;
+                break;
+            case 't':
+                extract_window = optarg;
+                break;
+            case 'Q':
+                pipeline_options.queue_capacity = strtoul(optarg, NULL, 10);
+                break;
+            case 'W':
+                pipeline_options.shard_count = atoi(optarg);
+                break;
+            case 'O':
+                pipeline_options.max_open_files = atoi(optarg);
+                break;
+            case 'o':
+                pipeline_options.archive_root = optarg;
+                break;
+            case 'U':
+                pipeline_options.use_uring = 1;
+                break;
+            case 'P':
+                pipeline_options.preallocate = 1;
+                break;
+            case 'D':
+                if (archive_parse_sync(optarg, &pipeline_options.sync_mode, &pipeline_options.sync_value) < 0) {
+                    seedlink_log(LOG_ERROR, "无效的持久化策略: %s", optarg);
+                    return 1;
+                }
+                break;
+            case 'C':
+                if (server_parse_policy(optarg, &client_policy, &client_queue) < 0) {
+                    seedlink_log(LOG_ERROR, "无效的客户端队列策略: %s", optarg);
+                    return 1;
+                }
+                break;
+            case 'H':
+                history_minutes = atoi(optarg);
+                if (history_minutes < 0) {
+                    seedlink_log(LOG_ERROR, "无效的最近数据时长: %s", optarg);
+                    return 1;
+                }
+                break;
+            case 'L':
+                if (archive_parse_layout(optarg) < 0) {
+                    seedlink_log(LOG_ERROR, "无效的存档布局: %s", optarg);
+                    return 1;
+                }
+                pipeline_options.archive_layout = (ArchiveLayout)archive_parse_layout(optarg);
+                break;
+            case 'A':
+            case 'F': {
+                int policy = queue_parse_policy(optarg);
+                if (policy < 0) {
+                    seedlink_log(LOG_ERROR, "无效的队列策略: %s", optarg);
+                    return 1;
+                }
+                if (opt == 'A') {
+                    pipeline_options.archive_policy = (QueuePolicy)policy;
+                } else {
+                    pipeline_options.fanout_policy = (QueuePolicy)policy;
+                }
+                break;
+            }
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    // 日志由后台线程统一写出，退出时写完剩余日志
+    if (log_start() == 0) {
+        atexit(log_shutdown);
+    }
+
+    // 提取模式：按时间索引从存档文件中取出一段数据
+    if (extract_file) {
+        return extract_records(extract_file, extract_window) == 0 ? 0 : 1;
+    }
+
+    raise_fd_limit();
+
+    // 基准测试模式：从内存中的语料驱动处理流程，不连接服务器
+    if (bench_file_count > 0) {
+        BenchOptions bench = { protocol, bench_loops > 0 ? bench_loops : 1, BENCH_DEFAULT_OUTPUT_DIR,
+                               pipeline_options.archive_layout };
+        return bench_run(bench_files, bench_file_count, &bench) == 0 ? 0 : 1;
+    }
+
     seedlink_log(LOG_INFO, "启动SeedLink客户端");
 
-    // 定义台站信息
+    if (upstream_count == 0) {
+        strcpy(upstreams[0].host, SEEDLINK_SERVER);
+        upstreams[0].port = SEEDLINK_PORT;
+        upstream_count = 1;
+    }
+
+    // 未指定台站列表时使用默认台站
     const char *network = "II";
     const char *station = "BFO";
     const char *location = "00";
@@ -22,6 +391,8 @@ int main()
         seedlink_log(LOG_ERROR, "创建TCP服务器失败");
         return 1;
     }
+    server_set_client_policy(server, client_policy, client_queue);
+    server_set_history(server, history_minutes * 60);
 
     // 在新线程中启动服务器
     pthread_t server_thread;
@@ -31,87 +402,92 @@ int main()
         return 1;
     }
 
-    // 创建SeedLink实例
-    seedlink_log(LOG_INFO, "正在创建SeedLink实例...");
-    SeedLink *sl = seedlink_create(SEEDLINK_SERVER, SEEDLINK_PORT);
-    if (!sl)
-    {
-        seedlink_log(LOG_ERROR, "创建SeedLink实例失败");
+    // 存档和转发线程，各自从自己的队列取数据
+    Pipeline* pipeline = pipeline_create(server, &pipeline_options);
+    if (!pipeline || pipeline_start(pipeline) < 0) {
+        seedlink_log(LOG_ERROR, "创建处理流水线失败");
+        pipeline_destroy(pipeline);
         server_destroy(server);
         return 1;
     }
 
-    // 连接服务器
-    seedlink_log(LOG_INFO, "正在连接到服务器 %s:%d...", SEEDLINK_SERVER, SEEDLINK_PORT);
-    if (seedlink_connect(sl) < 0)
-    {
-        seedlink_log(LOG_ERROR, "连接服务器失败");
-        seedlink_destroy(sl);
-        server_destroy(server);
-        return 1;
+    // 多个上游时创建去重索引
+    IngestContext ctx = { pipeline, NULL };
+    if (upstream_count > 1) {
+        ctx.dedup = dedup_create(dedup_capacity);
+        if (!ctx.dedup) {
+            seedlink_log(LOG_ERROR, "创建去重索引失败");
+            pipeline_destroy(pipeline);
+            server_destroy(server);
+            return 1;
+        }
     }
 
-    // 握手
-    seedlink_log(LOG_INFO, "正在进行握手...");
-    if (seedlink_handshake(sl) < 0)
+    // 创建接收引擎，所有台站连接共用一个epoll循环
+    seedlink_log(LOG_INFO, "正在创建接收引擎...");
+    IngestEngine* engine = ingest_create(handle_packet, &ctx);
+    if (!engine)
     {
-        seedlink_log(LOG_ERROR, "握手失败");
-        seedlink_destroy(sl);
+        seedlink_log(LOG_ERROR, "创建接收引擎失败");
+        dedup_destroy(ctx.dedup);
+        pipeline_destroy(pipeline);
         server_destroy(server);
         return 1;
     }
+    engine->protocol = protocol;
+    engine->pipelined = pipelined;
+    ingest_set_checkpoint(engine, checkpoint_mark, checkpoint_done);
 
-    // 请求多个通道的数据
-    seedlink_log(LOG_INFO, "正在请求台站数据: %s.%s.%s.*", network, station, location);
-    if (seedlink_request_channels(sl, network, station, location, channels, channel_count) < 0)
+    int added;
+    if (station_file) {
+        added = load_station_file(engine, station_file, upstreams, upstream_count);
+    } else {
+        added = add_station(engine, upstreams, upstream_count, network, station, location,
+                            channels, channel_count);
+    }
+    if (added <= 0)
     {
-        seedlink_log(LOG_ERROR, "请求台站数据失败");
-        seedlink_destroy(sl);
+        seedlink_log(LOG_ERROR, "没有可用的台站连接");
+        ingest_destroy(engine);
+        dedup_destroy(ctx.dedup);
+        pipeline_destroy(pipeline);
         server_destroy(server);
         return 1;
     }
 
-    // 读取数据
-    seedlink_log(LOG_INFO, "开始接收数据...");
-    char buffer[SEEDLINK_PACKET_SIZE];
-    SeedlinkPacket packet;
-    char filename[256];
+    // 恢复上次运行保存的序列号，重连时从断点续传
+    ingest_load_state(engine, state_file);
 
-    while (1)
-    {
-        int bytes_read = recv(sl->sockfd, buffer, SEEDLINK_PACKET_SIZE, MSG_WAITALL);
-        if (bytes_read <= 0)
-        {
-            seedlink_log(LOG_ERROR, "读取数据失败或连接关闭: %s", strerror(errno));
-            break;
-        }
-
-        if (bytes_read != SEEDLINK_PACKET_SIZE)
-        {
-            seedlink_log(LOG_WARN, "接收到不完整的数据包: %d字节", bytes_read);
-            continue;
-        }
-
-        // 解析SeedLink包头和miniSEED头
-        if (seedlink_parse_packet(buffer, &packet) == 0)
-        {
-            miniseed_parse_header(&packet.data.mseed);
+    g_engine = engine;
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
 
-            // 构造文件名并保存数据
-            format_mseed_filename(&packet.data.mseed, filename, sizeof(filename));
-            miniseed_save_data(&packet.data.raw, 512, filename);
+    // 读取数据
+    seedlink_log(LOG_INFO, "开始接收数据...");
+    ingest_run(engine);
+    g_engine = NULL;
 
-            // 直接转发miniSEED数据给所有连接的客户端
-            server_broadcast_data(server, (const unsigned char*)&packet.data.raw, 512);
-        }
+    if (ctx.dedup) {
+        seedlink_log(LOG_INFO, "去重统计: 丢弃重复记录%llu个, 淘汰条目%llu个",
+                     (unsigned long long)ctx.dedup->duplicates,
+                     (unsigned long long)ctx.dedup->evictions);
     }
 
-    // 清理资源
-    seedlink_destroy(sl);
+    // 清理资源：先等存档和转发线程处理完队列中的记录（剩余的溢写记录留在溢写文件中），
+    // 再保存最后收到的序列号
+    pipeline_stop(pipeline);
+    ingest_commit_state(engine);
+    ingest_destroy(engine);
+    dedup_destroy(ctx.dedup);
+    pipeline_destroy(pipeline);
     server_stop(server);
     pthread_join(server_thread, NULL);
     server_destroy(server);
-    
+
     seedlink_log(LOG_INFO, "客户端退出");
     return 0;
-}
\ No newline at end of file
+}
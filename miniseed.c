@@ -31,7 +31,7 @@ static void parse_blockette_1000(const unsigned char* data, int offset) {
     uint16_t next = swap16(b1000->next_blockette);
     int record_length = 1 << b1000->data_record_length;
     
-    seedlink_log(LOG_INFO, 
+    seedlink_log(LOG_DEBUG, 
         "B1000: type=%d next=%d 编码=%s(%d) %s 记录长度=2^%d=%d字节",
         type, next,
         get_encoding_str(b1000->encoding),
@@ -71,7 +71,7 @@ void miniseed_parse_header(const MiniSeedHeader* mseed) {
     // printf("\n");
     
     // 打印解析结果
-    seedlink_log(LOG_INFO, 
+    seedlink_log(LOG_DEBUG, 
         "miniSEED头解析: 序列号=%s 质量=%c %s.%s.%s.%s %04d-%03d %02d:%02d:%02d.%04d 采样率:%d/%d=%.1fHz 点数:%d",
         sequence,
         mseed->dataquality,
@@ -91,6 +91,254 @@ void miniseed_parse_header(const MiniSeedHeader* mseed) {
     }
 }
 
+// 按指定字节序读取整数
+static uint16_t read_u16(const unsigned char* p, int big_endian) {
+    return big_endian ? (uint16_t)((p[0] << 8) | p[1]) : (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t read_u32(const unsigned char* p, int big_endian) {
+    return big_endian ?
+        ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3] :
+        p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// 复制定长字段并去除末尾空格
+static void copy_code(char* dst, size_t size, const char* src, size_t len) {
+    if (len >= size) len = size - 1;
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+    for (int i = (int)len - 1; i >= 0 && (dst[i] == ' ' || dst[i] == '\0'); i--) {
+        dst[i] = '\0';
+    }
+}
+
+// 年、年积日和时分秒转换为自1970年起的纳秒数
+int64_t miniseed_epoch_ns(int year, int day, int hour, int min, int sec, uint32_t nsec) {
+    int64_t days = (int64_t)(year - 1970) * 365
+                 + (year - 1969) / 4 - (year - 1901) / 100 + (year - 1601) / 400
+                 + (day - 1);
+    int64_t seconds = days * 86400 + hour * 3600 + min * 60 + sec;
+    return seconds * 1000000000LL + nsec;
+}
+
+// 解析时间：YYYY-MM-DDTHH:MM:SS[.ffffff] 或 YYYY,DDD,HH:MM:SS[.ffffff]，均为UTC
+int miniseed_parse_time(const char* text, int64_t* time) {
+    static const int month_days[12] = { 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334 };
+    int year, month = 0, day, hour, min, sec, n = 0;
+
+    if (sscanf(text, "%d-%d-%d%*1[T ]%d:%d:%d%n", &year, &month, &day, &hour, &min, &sec, &n) == 6) {
+        if (month < 1 || month > 12 || day < 1 || day > 31) return -1;
+        int leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+        day += month_days[month - 1] + (leap && month > 2);
+    } else if (sscanf(text, "%d,%d,%d:%d:%d%n", &year, &day, &hour, &min, &sec, &n) != 5) {
+        return -1;
+    }
+    if (day < 1 || day > 366 || hour > 23 || min > 59 || sec > 60) return -1;
+
+    // 秒的小数部分
+    uint32_t nsec = 0;
+    const char* p = text + n;
+    if (*p == '.') {
+        uint32_t scale = 100000000;
+        for (p++; isdigit((unsigned char)*p); p++) {
+            nsec += (*p - '0') * scale;
+            scale /= 10;
+        }
+    }
+    if (*p != '\0' && *p != 'Z') return -1;
+
+    *time = miniseed_epoch_ns(year, day, hour, min, sec, nsec);
+    return 0;
+}
+
+// 按SEED规则由采样率因子和乘数计算采样率
+static double seed_sample_rate(int16_t factor, int16_t mult) {
+    if (factor == 0 || mult == 0) return 0.0;
+    if (factor > 0 && mult > 0) return (double)factor * mult;
+    if (factor > 0 && mult < 0) return -(double)factor / mult;
+    if (factor < 0 && mult > 0) return -(double)mult / factor;
+    return 1.0 / ((double)factor * mult);
+}
+
+// 解码miniSEED 2固定头，字节序由年份是否合理判断
+static int decode_mseed2(const unsigned char* record, size_t size, MiniSeedInfo* info) {
+    const MiniSeedHeader* mseed = (const MiniSeedHeader*)record;
+    const unsigned char* time = record + 20;
+    
+    int big_endian = 1;
+    uint16_t year = read_u16(time, 1);
+    if (year < 1900 || year > 2100) {
+        big_endian = 0;
+        year = read_u16(time, 0);
+        if (year < 1900 || year > 2100) return -1;
+    }
+    
+    info->format = 2;
+    copy_code(info->sequence, sizeof(info->sequence), mseed->sequence_number, 6);
+    copy_code(info->network, sizeof(info->network), mseed->network, 2);
+    copy_code(info->station, sizeof(info->station), mseed->station, 5);
+    copy_code(info->location, sizeof(info->location), mseed->location, 2);
+    copy_code(info->channel, sizeof(info->channel), mseed->channel, 3);
+    
+    info->year = year;
+    info->day = read_u16(time + 2, big_endian);
+    info->hour = mseed->hour;
+    info->min = mseed->min;
+    info->sec = mseed->sec;
+    info->nsec = (uint32_t)read_u16(time + 8, big_endian) * 100000;
+    info->num_samples = read_u16(record + 30, big_endian);
+    info->sample_rate = seed_sample_rate((int16_t)read_u16(record + 32, big_endian),
+                                         (int16_t)read_u16(record + 34, big_endian));
+    
+    // 记录长度取自Blockette 1000，没有时按传入的长度
+    info->record_length = (uint32_t)size;
+    uint16_t offset = read_u16(record + 46, big_endian);
+    for (int i = 0; i < mseed->numblockettes && offset >= 48 && (size_t)offset + 8 <= size; i++) {
+        if (read_u16(record + offset, big_endian) == 1000) {
+            info->record_length = 1u << record[offset + 6];
+            break;
+        }
+        offset = read_u16(record + offset + 2, big_endian);
+    }
+    
+    return 0;
+}
+
+// 解码miniSEED 3固定头（小端序），SID格式为 FDSN:NET_STA_LOC_B_S_SS
+static int decode_mseed3(const unsigned char* record, size_t size, MiniSeedInfo* info) {
+    uint8_t sid_length = record[33];
+    if ((size_t)MINISEED3_FIXED_HEADER_SIZE + sid_length > size) return -1;
+    
+    info->format = 3;
+    info->sequence[0] = '\0';
+    info->nsec = read_u32(record + 4, 0);
+    info->year = read_u16(record + 8, 0);
+    info->day = read_u16(record + 10, 0);
+    info->hour = record[12];
+    info->min = record[13];
+    info->sec = record[14];
+    info->num_samples = read_u32(record + 24, 0);
+    info->record_length = MINISEED3_FIXED_HEADER_SIZE + sid_length
+                        + read_u16(record + 34, 0) + read_u32(record + 36, 0);
+    
+    double rate;
+    memcpy(&rate, record + 16, sizeof(rate));
+    info->sample_rate = rate < 0 ? -1.0 / rate : rate;
+    
+    // 拆分SID，频带/源/子源三段合并为通道代码
+    char sid[256];
+    memcpy(sid, record + MINISEED3_FIXED_HEADER_SIZE, sid_length);
+    sid[sid_length] = '\0';
+    
+    char* fields[6] = {0};
+    int count = 0;
+    char* p = strncmp(sid, "FDSN:", 5) == 0 ? sid + 5 : sid;
+    while (count < 6) {
+        fields[count++] = p;
+        p = strchr(p, '_');
+        if (!p) break;
+        *p++ = '\0';
+    }
+    if (count != 6) return -1;
+    
+    copy_code(info->network, sizeof(info->network), fields[0], strlen(fields[0]));
+    copy_code(info->station, sizeof(info->station), fields[1], strlen(fields[1]));
+    copy_code(info->location, sizeof(info->location), fields[2], strlen(fields[2]));
+    snprintf(info->channel, sizeof(info->channel), "%s%s%s", fields[3], fields[4], fields[5]);
+    
+    return 0;
+}
+
+// 解码记录头，得到台站、时间和采样信息
+int miniseed_decode(const unsigned char* record, size_t size, MiniSeedInfo* info) {
+    if (!record || !info) return -1;
+    
+    int rc;
+    if (size >= MINISEED3_FIXED_HEADER_SIZE && record[0] == 'M' && record[1] == 'S' && record[2] == 3) {
+        rc = decode_mseed3(record, size, info);
+    } else if (size >= sizeof(MiniSeedHeader)) {
+        rc = decode_mseed2(record, size, info);
+    } else {
+        rc = -1;
+    }
+    
+    if (rc < 0) {
+        seedlink_log(LOG_WARN, "无法识别的miniSEED记录 (%zu字节)", size);
+        return -1;
+    }
+    
+    info->start_time = miniseed_epoch_ns(info->year, info->day, info->hour, info->min, info->sec, info->nsec);
+    return 0;
+}
+
+// 记录结束时间（最后一个采样点之后），单位纳秒
+int64_t miniseed_end_time(const MiniSeedInfo* info) {
+    if (info->sample_rate <= 0 || info->num_samples == 0) return info->start_time;
+    return info->start_time + (int64_t)(info->num_samples / info->sample_rate * 1e9);
+}
+
+// 台站/通道的哈希值（FNV-1a），同一通道的记录总是得到相同的值
+uint64_t miniseed_nslc_hash(const MiniSeedInfo* info) {
+    const char* fields[4] = { info->network, info->station, info->location, info->channel };
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int i = 0; i < 4; i++) {
+        for (const char* p = fields[i]; ; p++) {
+            hash ^= (unsigned char)*p;
+            hash *= 0x100000001b3ULL;
+            if (*p == '\0') break;
+        }
+    }
+    hash ^= hash >> 33;
+    return hash;
+}
+
+// 通配符匹配：?匹配单个字符，*匹配任意长度
+int miniseed_wildcard_match(const char* pattern, const char* text) {
+    if (*pattern == '\0') return *text == '\0';
+    if (*pattern == '*') {
+        return miniseed_wildcard_match(pattern + 1, text) || (*text && miniseed_wildcard_match(pattern, text + 1));
+    }
+    if (*text && (*pattern == '?' || *pattern == *text)) {
+        return miniseed_wildcard_match(pattern + 1, text + 1);
+    }
+    return 0;
+}
+
+// 解析 NET.STA.LOC.CHA 格式的通道模式，各段可用?和*，位置码为空时写 -- 或留空；
+// 只写 * 表示所有通道
+int miniseed_parse_pattern(const char* text, NslcPattern* pattern) {
+    char* fields[4] = { pattern->network, pattern->station, pattern->location, pattern->channel };
+    size_t sizes[4] = { sizeof(pattern->network), sizeof(pattern->station),
+                        sizeof(pattern->location), sizeof(pattern->channel) };
+    
+    if (strcmp(text, "*") == 0) {
+        for (int i = 0; i < 4; i++) strcpy(fields[i], "*");
+        return 0;
+    }
+    
+    const char* p = text;
+    for (int i = 0; i < 4; i++) {
+        const char* end = i < 3 ? strchr(p, '.') : p + strlen(p);
+        if (!end || (size_t)(end - p) >= sizes[i]) return -1;
+        for (size_t j = 0; j < (size_t)(end - p); j++) {
+            fields[i][j] = (char)toupper((unsigned char)p[j]);
+        }
+        fields[i][end - p] = '\0';
+        p = end + 1;
+    }
+    if (strcmp(pattern->location, "--") == 0) pattern->location[0] = '\0';
+    return 0;
+}
+
+// 按NSLC字符串匹配，既可用于解码出的记录头，也可用于缓存的通道名
+int miniseed_match_pattern(const NslcPattern* pattern, const char* network, const char* station,
+                           const char* location, const char* channel) {
+    return miniseed_wildcard_match(pattern->network, network) &&
+           miniseed_wildcard_match(pattern->station, station) &&
+           miniseed_wildcard_match(pattern->location, location) &&
+           miniseed_wildcard_match(pattern->channel, channel);
+}
+
 // 保存miniSEED数据
 int miniseed_save_data(const void* data, size_t size, const char* filename) {
     FILE* fp = fopen(filename, "ab");
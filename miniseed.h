@@ -2,6 +2,11 @@
 #define MINISEED_H
 
 #include <stdint.h>
+#include <stddef.h>
+
+#define MINISEED_MIN_RECORD_LENGTH 256    // miniSEED 2 最小记录长度
+#define MINISEED_MAX_RECORD_LENGTH 8192   // 接收的最大记录长度（miniSEED 2/3）
+#define MINISEED3_FIXED_HEADER_SIZE 40    // miniSEED 3 固定头长度（不含SID）
 
 // miniSEED 2.4 固定头结构体 (48字节)
 #pragma pack(1)
@@ -43,8 +48,45 @@ typedef struct {
 } Blockette1000;
 #pragma pack()
 
+// 解码后的记录信息，miniSEED 2 和 miniSEED 3 通用
+typedef struct {
+    int         format;             // 2 或 3
+    char        network[9];         // 台网代码（已去除空格）
+    char        station[9];         // 台站代码
+    char        location[9];        // 位置标识
+    char        channel[12];        // 通道代码
+    char        sequence[7];        // miniSEED 2 记录序列号
+    uint16_t    year;
+    uint16_t    day;
+    uint8_t     hour;
+    uint8_t     min;
+    uint8_t     sec;
+    uint32_t    nsec;               // 秒内纳秒
+    int64_t     start_time;         // 开始时间（自1970年起的纳秒数）
+    double      sample_rate;        // 采样率(Hz)
+    uint32_t    num_samples;        // 采样点数
+    uint32_t    record_length;      // 记录长度（字节）
+} MiniSeedInfo;
+
+// 通道模式 NET.STA.LOC.CHA，各段可含?和*通配符
+typedef struct {
+    char        network[9];
+    char        station[9];
+    char        location[9];
+    char        channel[12];
+} NslcPattern;
+
 // 函数声明
 void miniseed_parse_header(const MiniSeedHeader* mseed);
+int miniseed_decode(const unsigned char* record, size_t size, MiniSeedInfo* info);
+int64_t miniseed_epoch_ns(int year, int day, int hour, int min, int sec, uint32_t nsec);
+int miniseed_parse_time(const char* text, int64_t* time);
+int64_t miniseed_end_time(const MiniSeedInfo* info);
+uint64_t miniseed_nslc_hash(const MiniSeedInfo* info);
+int miniseed_wildcard_match(const char* pattern, const char* text);
+int miniseed_parse_pattern(const char* text, NslcPattern* pattern);
+int miniseed_match_pattern(const NslcPattern* pattern, const char* network, const char* station,
+                           const char* location, const char* channel);
 int miniseed_save_data(const void* data, size_t size, const char* filename);
 
 #endif 
\ No newline at end of file
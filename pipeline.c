@@ -0,0 +1,350 @@
+#include <time.h>
+#include <sys/stat.h>
+#include "pipeline.h"
+
+void pipeline_default_options(PipelineOptions* options) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    options->queue_capacity = PIPELINE_QUEUE_CAPACITY;
+    options->shard_count = cpus < 1 ? 1 : (cpus > 8 ? 8 : (int)cpus);
+    options->max_open_files = ARCHIVE_DEFAULT_MAX_OPEN;
+    options->use_uring = 0;
+    options->sync_mode = ARCHIVE_SYNC_NONE;
+    options->sync_value = 0;
+    options->preallocate = 0;
+    options->archive_root = ".";
+    options->archive_layout = ARCHIVE_LAYOUT_FLAT;
+    options->archive_policy = QUEUE_POLICY_SPILL;
+    options->fanout_policy = QUEUE_POLICY_DROP_OLDEST;
+}
+
+// 创建一个阶段的队列，溢写策略时打开溢写文件，打不开或布局不符时创建失败
+static DataQueue* create_stage_queue(size_t capacity, QueuePolicy policy, const char* spill_path, uint32_t layout) {
+    DataQueue* queue = queue_create(capacity, MINISEED_MAX_RECORD_LENGTH);
+    if (!queue) return NULL;
+    
+    queue_set_policy(queue, policy);
+    if (policy == QUEUE_POLICY_SPILL && queue_set_spill_file(queue, spill_path, layout) < 0) {
+        seedlink_log(LOG_ERROR, "无法使用溢写文件 %s", spill_path);
+        queue_destroy(queue);
+        return NULL;
+    }
+    return queue;
+}
+
+Pipeline* pipeline_create(TCPServer* server, const PipelineOptions* options) {
+    Pipeline* pipeline = (Pipeline*)calloc(1, sizeof(Pipeline));
+    if (!pipeline) return NULL;
+    
+    pipeline->server = server;
+    pipeline->shard_count = options->shard_count;
+    if (pipeline->shard_count < 1) pipeline->shard_count = 1;
+    if (pipeline->shard_count > PIPELINE_MAX_SHARDS) pipeline->shard_count = PIPELINE_MAX_SHARDS;
+    
+    pipeline->shards = (PipelineShard*)calloc(pipeline->shard_count, sizeof(PipelineShard));
+    if (!pipeline->shards) {
+        free(pipeline);
+        return NULL;
+    }
+    // 溢写文件在存档根目录下，先确保目录存在
+    char spill_path[ARCHIVE_PATH_SIZE];
+    if (mkdir(options->archive_root, 0755) < 0 && errno != EEXIST) {
+        seedlink_log(LOG_ERROR, "无法创建存档目录 %s: %s", options->archive_root, strerror(errno));
+    }
+    
+    // 溢写的记录按分片数取模分配，分片数变小时多出的分片的溢写文件无法放回，拒绝启动
+    if (options->archive_policy == QUEUE_POLICY_SPILL) {
+        for (int i = pipeline->shard_count; i < PIPELINE_MAX_SHARDS; i++) {
+            struct stat st;
+            snprintf(spill_path, sizeof(spill_path), PIPELINE_ARCHIVE_SPILL, options->archive_root, i);
+            if (stat(spill_path, &st) == 0 && st.st_size > (off_t)sizeof(QueueSpillHeader)) {
+                seedlink_log(LOG_ERROR, "溢写文件 %s 中还有记录，但当前只有%d个存档分片，请使用原来的 -W 启动处理完这些记录",
+                             spill_path, pipeline->shard_count);
+                free(pipeline->shards);
+                free(pipeline);
+                return NULL;
+            }
+        }
+    }
+    
+    // fd预算平均分给各存档线程
+    int max_open = options->max_open_files / pipeline->shard_count;
+    for (int i = 0; i < pipeline->shard_count; i++) {
+        snprintf(spill_path, sizeof(spill_path), PIPELINE_ARCHIVE_SPILL, options->archive_root, i);
+        pipeline->shards[i].pipeline = pipeline;
+        pipeline->shards[i].index = i;
+        pipeline->shards[i].queue = create_stage_queue(options->queue_capacity,
+                                                       options->archive_policy, spill_path,
+                                                       (uint32_t)pipeline->shard_count);
+        pipeline->shards[i].writer = archive_create(options->archive_root, options->archive_layout,
+                                                    max_open, ARCHIVE_IDLE_TIMEOUT_MS);
+        if (!pipeline->shards[i].queue || !pipeline->shards[i].writer) {
+            pipeline_destroy(pipeline);
+            return NULL;
+        }
+        pipeline->shards[i].submitted = pipeline->shards[i].queue->spill_pending;
+        archive_set_sync(pipeline->shards[i].writer, options->sync_mode, options->sync_value);
+        archive_set_preallocate(pipeline->shards[i].writer, options->preallocate);
+        if (options->use_uring) {
+            archive_enable_uring(pipeline->shards[i].writer, ARCHIVE_URING_ENTRIES);
+        }
+    }
+    
+    snprintf(spill_path, sizeof(spill_path), PIPELINE_FANOUT_SPILL, options->archive_root);
+    pipeline->fanout_queue = create_stage_queue(options->queue_capacity, options->fanout_policy,
+                                                spill_path, 1);
+    if (!pipeline->fanout_queue) {
+        pipeline_destroy(pipeline);
+        return NULL;
+    }
+    return pipeline;
+}
+
+// 存档线程：按通道追加到数据文件，没有数据时也定期关闭空闲的文件
+// 使用io_uring时两个批次缓冲区轮流使用并注册为固定缓冲区：一批写入提交后不等待完成，
+// 直接取下一批，再次使用某个缓冲区之前才等待它的写入完成，这时才把这一批计入completed
+static void* archive_thread(void* arg) {
+    PipelineShard* shard = (PipelineShard*)arg;
+    ArchiveWriter* writer = shard->writer;
+    int batch_count = writer->ring ? 2 : 1;
+    QueueBatch* batches[2] = { NULL, NULL };
+    struct iovec buffers[2];
+    
+    for (int i = 0; i < batch_count; i++) {
+        batches[i] = queue_batch_create(shard->queue, PIPELINE_BATCH_SIZE);
+        if (!batches[i]) goto done;
+        buffers[i].iov_base = batches[i]->slots;
+        buffers[i].iov_len = batches[i]->capacity * batches[i]->slot_stride;
+    }
+    if (writer->ring) archive_register_buffers(writer, buffers, batch_count);
+    
+    // 文件因超出fd预算被淘汰时提示调大-O，最多每分钟一次
+    uint64_t reported_evictions = 0;
+    time_t last_report = 0;
+    
+    uint64_t unconfirmed[2] = { 0, 0 };
+    for (int current = 0; ; current = (current + 1) % batch_count) {
+        QueueBatch* batch = batches[current];
+        archive_wait_buffer(writer, current);
+        atomic_fetch_add_explicit(&shard->completed, unconfirmed[current], memory_order_release);
+        unconfirmed[current] = 0;
+        if (queue_pop_many(shard->queue, batch, PIPELINE_BATCH_SIZE, PIPELINE_IDLE_CHECK_MS) < 0) break;
+        
+        for (size_t i = 0; i < batch->count; i++) {
+            const QueueSlot* slot = queue_batch_slot(batch, i);
+            if (archive_write(writer, &slot->info, slot->data, slot->length) == 0) {
+                shard->bytes += slot->length;
+            }
+        }
+        archive_submit(writer);
+        archive_flush_index(writer);
+        shard->records += batch->count;
+        if (writer->ring) {
+            unconfirmed[current] = batch->count;
+        } else {
+            atomic_fetch_add_explicit(&shard->completed, batch->count, memory_order_release);
+        }
+        if (writer->evictions > reported_evictions && time(NULL) - last_report >= 60) {
+            seedlink_log(LOG_WARN, "存档分片%d: 打开的文件超出fd预算(%d)，已淘汰%llu个文件，频繁重新打开会降低写入性能，可用-O调大",
+                         shard->index, writer->max_open,
+                         (unsigned long long)(writer->evictions - reported_evictions));
+            reported_evictions = writer->evictions;
+            last_report = time(NULL);
+        }
+        archive_close_idle(writer);
+        archive_maybe_sync(writer);
+    }
+    
+done:
+    // 退出前写完并按策略同步所有文件
+    archive_drain(writer);
+    if (writer->sync_mode != ARCHIVE_SYNC_NONE) archive_sync(writer);
+    atomic_fetch_add_explicit(&shard->completed, unconfirmed[0] + unconfirmed[1], memory_order_release);
+    for (int i = 0; i < batch_count; i++) {
+        queue_batch_destroy(batches[i]);
+    }
+    return NULL;
+}
+
+// 转发线程：把记录成批交给转发服务器，发送由服务器的事件循环完成
+static void* fanout_thread(void* arg) {
+    Pipeline* pipeline = (Pipeline*)arg;
+    QueueBatch* batch = queue_batch_create(pipeline->fanout_queue, PIPELINE_BATCH_SIZE);
+    if (!batch) return NULL;
+    
+    QueueRecord records[PIPELINE_BATCH_SIZE];
+    while (queue_pop_many(pipeline->fanout_queue, batch, PIPELINE_BATCH_SIZE, -1) >= 0) {
+        for (size_t i = 0; i < batch->count; i++) {
+            const QueueSlot* slot = queue_batch_slot(batch, i);
+            records[i].info = &slot->info;
+            records[i].data = slot->data;
+            records[i].length = slot->length;
+        }
+        server_broadcast_records(pipeline->server, records, (int)batch->count);
+        pipeline->broadcast += batch->count;
+    }
+    
+    queue_batch_destroy(batch);
+    return NULL;
+}
+
+// 关闭所有队列，等待已启动的线程处理完剩余记录后退出
+static void join_threads(Pipeline* pipeline) {
+    for (int i = 0; i < pipeline->shard_count; i++) {
+        queue_close(pipeline->shards[i].queue);
+    }
+    queue_close(pipeline->fanout_queue);
+    
+    for (int i = 0; i < pipeline->started && i < pipeline->shard_count; i++) {
+        pthread_join(pipeline->shards[i].thread, NULL);
+    }
+    if (pipeline->started > pipeline->shard_count) {
+        pthread_join(pipeline->fanout_thread, NULL);
+    }
+    pipeline->started = 0;
+}
+
+int pipeline_start(Pipeline* pipeline) {
+    for (int i = 0; i < pipeline->shard_count; i++) {
+        if (pthread_create(&pipeline->shards[i].thread, NULL, archive_thread, &pipeline->shards[i]) != 0) {
+            seedlink_log(LOG_ERROR, "启动存档线程失败");
+            join_threads(pipeline);
+            return -1;
+        }
+        pipeline->started++;
+    }
+    if (pthread_create(&pipeline->fanout_thread, NULL, fanout_thread, pipeline) != 0) {
+        seedlink_log(LOG_ERROR, "启动转发线程失败");
+        join_threads(pipeline);
+        return -1;
+    }
+    pipeline->started++;
+    
+    seedlink_log(LOG_INFO, "处理流水线已启动: %d 个存档线程", pipeline->shard_count);
+    return 0;
+}
+
+// 把一条记录交给存档和转发两个阶段，由接收线程调用。
+// 记录先暂存，data须保持有效直到下一次pipeline_flush；攒满一批时立即入队
+int pipeline_submit(Pipeline* pipeline, const MiniSeedInfo* info, const unsigned char* data, size_t length) {
+    size_t n = pipeline->pending_count++;
+    pipeline->pending_info[n] = *info;
+    pipeline->pending[n].info = &pipeline->pending_info[n];
+    pipeline->pending[n].data = data;
+    pipeline->pending[n].length = length;
+    return n + 1 == PIPELINE_BATCH_SIZE ? pipeline_flush(pipeline) : 0;
+}
+
+// 把暂存的记录成批入队：存档按NSLC哈希选择分片，每个分片和转发队列各加一次锁
+int pipeline_flush(Pipeline* pipeline) {
+    size_t count = pipeline->pending_count;
+    if (count == 0) return 0;
+    pipeline->pending_count = 0;
+    
+    int rc = 0;
+    if (pipeline->shard_count == 1) {
+        pipeline->shards[0].submitted += count;
+        if (queue_push_many(pipeline->shards[0].queue, pipeline->pending, count) != count) rc = -1;
+    } else {
+        unsigned char shard_of[PIPELINE_BATCH_SIZE];
+        for (size_t i = 0; i < count; i++) {
+            shard_of[i] = (unsigned char)(miniseed_nslc_hash(pipeline->pending[i].info) % pipeline->shard_count);
+        }
+        QueueRecord records[PIPELINE_BATCH_SIZE];
+        for (size_t i = 0; i < count; i++) {
+            if (shard_of[i] == 0xFF) continue;
+            int shard = shard_of[i];
+            size_t n = 0;
+            for (size_t j = i; j < count; j++) {
+                if (shard_of[j] != shard) continue;
+                records[n++] = pipeline->pending[j];
+                shard_of[j] = 0xFF;
+            }
+            pipeline->shards[shard].submitted += n;
+            if (queue_push_many(pipeline->shards[shard].queue, records, n) != n) rc = -1;
+        }
+    }
+    if (queue_push_many(pipeline->fanout_queue, pipeline->pending, count) != count) rc = -1;
+    return rc;
+}
+
+// 记下各分片目前收到的记录数作为检查点，由接收线程在pipeline_flush之后调用
+void pipeline_checkpoint(Pipeline* pipeline) {
+    for (int i = 0; i < pipeline->shard_count; i++) {
+        pipeline->shards[i].checkpoint = pipeline->shards[i].submitted;
+    }
+}
+
+// 检查点之前的记录是否都已写入存档（或被队列丢弃），由接收线程调用
+int pipeline_checkpoint_done(Pipeline* pipeline) {
+    for (int i = 0; i < pipeline->shard_count; i++) {
+        PipelineShard* shard = &pipeline->shards[i];
+        pthread_mutex_lock(&shard->queue->mutex);
+        uint64_t dropped = shard->queue->dropped;
+        pthread_mutex_unlock(&shard->queue->mutex);
+        uint64_t done = atomic_load_explicit(&shard->completed, memory_order_acquire) + dropped;
+        if (done < shard->checkpoint) return 0;
+    }
+    return 1;
+}
+
+// 运行中定期输出各存档分片和转发队列的深度、丢弃和溢写数，由接收线程调用，
+// 不到PIPELINE_REPORT_INTERVAL秒时直接返回
+void pipeline_report(Pipeline* pipeline) {
+    time_t now = time(NULL);
+    if (now - pipeline->reported_at < PIPELINE_REPORT_INTERVAL) return;
+    pipeline->reported_at = now;
+    
+    QueueStats stats;
+    for (int i = 0; i < pipeline->shard_count; i++) {
+        PipelineShard* shard = &pipeline->shards[i];
+        queue_get_stats(shard->queue, &stats);
+        seedlink_log(LOG_INFO, "存档分片%d: 队列%zu条, 溢写中%zu条, 已保存%llu条 (丢弃%llu, 溢写%llu)",
+                     i, stats.depth, stats.spill_pending,
+                     (unsigned long long)atomic_load_explicit(&shard->completed, memory_order_relaxed),
+                     (unsigned long long)stats.dropped, (unsigned long long)stats.spilled);
+    }
+    queue_get_stats(pipeline->fanout_queue, &stats);
+    seedlink_log(LOG_INFO, "转发队列: %zu条, 溢写中%zu条 (丢弃%llu, 溢写%llu)",
+                 stats.depth, stats.spill_pending,
+                 (unsigned long long)stats.dropped, (unsigned long long)stats.spilled);
+}
+
+// 停止流水线并输出各分片的负载
+void pipeline_stop(Pipeline* pipeline) {
+    if (!pipeline->started) return;
+    join_threads(pipeline);
+    
+    for (int i = 0; i < pipeline->shard_count; i++) {
+        const PipelineShard* shard = &pipeline->shards[i];
+        seedlink_log(LOG_INFO, "存档分片%d: %llu 条 %llu 字节 (丢弃%llu, 溢写%llu, 打开文件%llu次, 淘汰%llu, 空闲关闭%llu, 换日关闭%llu, 提交%llu次, 同步%llu个文件/%llu批, 预分配%llu次)",
+                     i, (unsigned long long)shard->records, (unsigned long long)shard->bytes,
+                     (unsigned long long)shard->queue->dropped,
+                     (unsigned long long)shard->queue->spilled,
+                     (unsigned long long)shard->writer->opens,
+                     (unsigned long long)shard->writer->evictions,
+                     (unsigned long long)shard->writer->idle_closes,
+                     (unsigned long long)shard->writer->rotations,
+                     (unsigned long long)shard->writer->submits,
+                     (unsigned long long)shard->writer->syncs,
+                     (unsigned long long)shard->writer->sync_passes,
+                     (unsigned long long)shard->writer->preallocations);
+    }
+    seedlink_log(LOG_INFO, "转发 %llu 条 (丢弃%llu, 溢写%llu)",
+                 (unsigned long long)pipeline->broadcast,
+                 (unsigned long long)pipeline->fanout_queue->dropped,
+                 (unsigned long long)pipeline->fanout_queue->spilled);
+}
+
+void pipeline_destroy(Pipeline* pipeline) {
+    if (!pipeline) return;
+    pipeline_stop(pipeline);
+    if (pipeline->shards) {
+        for (int i = 0; i < pipeline->shard_count; i++) {
+            queue_destroy(pipeline->shards[i].queue);
+            archive_destroy(pipeline->shards[i].writer);
+        }
+        free(pipeline->shards);
+    }
+    queue_destroy(pipeline->fanout_queue);
+    free(pipeline);
+}
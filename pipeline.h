@@ -0,0 +1,88 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "queue.h"
+#include "server.h"
+#include "archive.h"
+
+#define PIPELINE_QUEUE_CAPACITY 1024    // 每个阶段队列的默认槽位数
+#define PIPELINE_BATCH_SIZE 64          // 每次从队列取出的最大记录数
+#define PIPELINE_MAX_SHARDS 64           // 存档线程数上限
+#define PIPELINE_IDLE_CHECK_MS 1000      // 存档线程检查空闲文件的间隔
+#define PIPELINE_REPORT_INTERVAL 60      // 运行中输出各队列统计的间隔（秒）
+#define PIPELINE_ARCHIVE_SPILL "%s/archive.%d.spill"   // 溢写文件放在存档根目录下
+#define PIPELINE_FANOUT_SPILL "%s/fanout.spill"
+
+// 流水线参数
+typedef struct {
+    size_t queue_capacity;
+    int shard_count;                // 存档线程数，默认为CPU核数（最多8个）
+    int max_open_files;             // 所有存档线程合计最多占用的fd数（数据文件和索引各占一个）
+    int use_uring;                  // 存档线程使用io_uring批量提交写入
+    ArchiveSyncMode sync_mode;      // 存档文件的持久化策略
+    int sync_value;
+    int preallocate;                // 用fallocate按估计的日数据量预分配存档文件
+    const char* archive_root;       // 存档根目录
+    ArchiveLayout archive_layout;
+    QueuePolicy archive_policy;     // 存档队列满时的策略，默认溢写到磁盘，不丢数据
+    QueuePolicy fanout_policy;      // 转发队列满时的策略，默认丢弃最早的记录
+} PipelineOptions;
+
+struct Pipeline;
+
+// 一个存档分片：一个队列和一个线程
+typedef struct {
+    struct Pipeline* pipeline;
+    int index;
+    DataQueue* queue;
+    ArchiveWriter* writer;
+    pthread_t thread;
+    uint64_t records;       // 已保存的记录数（由分片线程更新）
+    uint64_t bytes;
+    
+    // 检查点：submitted由接收线程更新（含启动时从溢写文件放回的记录），
+    // completed由分片线程在写入完成后更新，两者之差加上队列丢弃的记录数即为未处理完的记录
+    uint64_t submitted;
+    uint64_t checkpoint;
+    atomic_uint_least64_t completed;
+} PipelineShard;
+
+// 多线程处理流水线
+// 接收线程只负责切分、解码并入队；存档和转发各自从自己的队列中批量取出记录，
+// 磁盘写入和客户端发送都不会阻塞上游socket的读取。
+// 存档按NSLC哈希分到多个分片，同一通道总由同一个线程写入，保证文件中记录的顺序
+typedef struct Pipeline {
+    PipelineShard* shards;
+    int shard_count;
+    DataQueue* fanout_queue;
+    pthread_t fanout_thread;
+    int started;            // 已启动的存档线程数，转发线程启动后加一
+    TCPServer* server;
+    
+    // 接收线程暂存的记录：一次读取的数据包处理完（或攒满一批）时按分片成批入队，
+    // 每个队列每批只加一次锁。记录数据仍在接收缓冲区中，入队时才复制
+    QueueRecord pending[PIPELINE_BATCH_SIZE];
+    MiniSeedInfo pending_info[PIPELINE_BATCH_SIZE];
+    size_t pending_count;
+    
+    // 统计（由转发线程更新，停止后读取）
+    uint64_t broadcast;
+    time_t reported_at;     // 上次输出队列统计的时间
+
+} Pipeline;
+
+// 函数声明
+void pipeline_default_options(PipelineOptions* options);
+Pipeline* pipeline_create(TCPServer* server, const PipelineOptions* options);
+int pipeline_start(Pipeline* pipeline);
+int pipeline_submit(Pipeline* pipeline, const MiniSeedInfo* info, const unsigned char* data, size_t length);
+int pipeline_flush(Pipeline* pipeline);
+void pipeline_checkpoint(Pipeline* pipeline);
+void pipeline_report(Pipeline* pipeline);
+int pipeline_checkpoint_done(Pipeline* pipeline);
+void pipeline_stop(Pipeline* pipeline);
+void pipeline_destroy(Pipeline* pipeline);
+
+#endif
@@ -1,91 +1,652 @@
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
+#include <time.h>
+#include <fcntl.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include "queue.h"
 #include "seedlink.h"
 
-DataQueue* queue_create(void) {
-    DataQueue* queue = (DataQueue*)malloc(sizeof(DataQueue));
+// 第index个槽位
+static QueueSlot* slot_at(const DataQueue* queue, size_t index) {
+    return (QueueSlot*)(queue->slots + (index & queue->mask) * queue->slot_stride);
+}
+
+// 槽位中需要复制的字节数：记录头加实际数据
+static size_t slot_bytes(const QueueSlot* slot) {
+    return offsetof(QueueSlot, data) + slot->length;
+}
+
+DataQueue* queue_create(size_t capacity, size_t slot_size) {
+    // 槽位数向上取整为2的幂，用掩码代替取模
+    size_t slots = 1;
+    while (slots < capacity) slots <<= 1;
+    
+    DataQueue* queue = (DataQueue*)calloc(1, sizeof(DataQueue));
     if (!queue) return NULL;
     
-    queue->front = queue->rear = NULL;
-    queue->size = 0;
-    pthread_mutex_init(&queue->mutex, NULL);
-    pthread_cond_init(&queue->not_empty, NULL);
+    queue->mask = slots - 1;
+    queue->slot_size = slot_size;
+    queue->slot_stride = (sizeof(QueueSlot) + slot_size + QUEUE_CACHE_LINE - 1)
+                       & ~(size_t)(QUEUE_CACHE_LINE - 1);
+    queue->slots = (unsigned char*)aligned_alloc(QUEUE_CACHE_LINE, slots * queue->slot_stride);
+    if (!queue->slots) {
+        seedlink_log(LOG_ERROR, "分配队列槽位失败 (%zu x %zu字节)", slots, queue->slot_stride);
+        free(queue);
+        return NULL;
+    }
     
+    // 超时等待使用单调时钟，不受系统时间调整影响
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&queue->mutex, NULL);
+    pthread_cond_init(&queue->not_empty, &attr);
+    pthread_cond_init(&queue->not_full, &attr);
+    pthread_condattr_destroy(&attr);
+    queue->policy = QUEUE_POLICY_BLOCK;
+    queue->spill_fd = -1;
     return queue;
 }
 
+static int spill_write_at(int fd, const unsigned char* data, size_t length, off_t offset);
+
 void queue_destroy(DataQueue* queue) {
     if (!queue) return;
     
-    pthread_mutex_lock(&queue->mutex);
-    while (queue->front) {
-        QueueNode* temp = queue->front;
-        queue->front = queue->front->next;
-        free(temp);
+    // 内存块中的记录写入溢写文件，下次启动时放回
+    for (QueueSpillBlock* block = queue->spill_head; block && queue->spill_fd >= 0; block = block->next) {
+        if (block->read == block->length) continue;
+        if (spill_write_at(queue->spill_fd, block->data + block->read, block->length - block->read,
+                           queue->spill_write_offset) < 0) {
+            queue->dropped += block->records;
+            queue->spill_pending -= block->records;
+            continue;
+        }
+        queue->spill_write_offset += block->length - block->read;
     }
-    pthread_mutex_unlock(&queue->mutex);
-    
+    if (queue->spill_pending > 0) {
+        seedlink_log(LOG_WARN, "队列销毁时还有%zu条溢写的记录未处理，保留在溢写文件中", queue->spill_pending);
+    }
+    while (queue->spill_head || queue->spill_free) {
+        QueueSpillBlock** list = queue->spill_head ? &queue->spill_head : &queue->spill_free;
+        QueueSpillBlock* block = *list;
+        *list = block->next;
+        free(block);
+    }
+    if (queue->spill_fd >= 0) close(queue->spill_fd);
+    free(queue->spill_stage);
     pthread_mutex_destroy(&queue->mutex);
     pthread_cond_destroy(&queue->not_empty);
+    pthread_cond_destroy(&queue->not_full);
+    free(queue->slots);
     free(queue);
 }
 
-int queue_push(DataQueue* queue, const char* network, const char* station,
-              const char* location, const char* channel, const unsigned char* data) {
-    QueueNode* node = (QueueNode*)malloc(sizeof(QueueNode));
-    if (!node) return -1;
+// 关闭队列，唤醒所有等待的线程
+void queue_close(DataQueue* queue) {
+    pthread_mutex_lock(&queue->mutex);
+    queue->closed = 1;
+    pthread_cond_broadcast(&queue->not_empty);
+    pthread_cond_broadcast(&queue->not_full);
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+// 队列中的记录数（不含溢写中的记录）
+size_t queue_size(DataQueue* queue) {
+    pthread_mutex_lock(&queue->mutex);
+    size_t size = queue->tail - queue->head;
+    pthread_mutex_unlock(&queue->mutex);
+    return size;
+}
+
+// 加锁读取队列深度和丢弃、溢写计数，供其他线程定期输出
+void queue_get_stats(DataQueue* queue, QueueStats* stats) {
+    pthread_mutex_lock(&queue->mutex);
+    stats->depth = queue->tail - queue->head;
+    stats->spill_pending = queue->spill_pending;
+    stats->dropped = queue->dropped;
+    stats->spilled = queue->spilled;
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+static const char* policy_names[] = {"block", "drop-oldest", "drop-newest", "spill"};
+
+int queue_parse_policy(const char* name) {
+    for (int i = 0; i < (int)(sizeof(policy_names) / sizeof(policy_names[0])); i++) {
+        if (strcasecmp(name, policy_names[i]) == 0) return i;
+    }
+    return -1;
+}
+
+void queue_set_policy(DataQueue* queue, QueuePolicy policy) {
+    pthread_mutex_lock(&queue->mutex);
+    queue->policy = policy;
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+int queue_set_channel_policy(DataQueue* queue, const char* channel, QueuePolicy policy) {
+    pthread_mutex_lock(&queue->mutex);
+    if (queue->channel_policy_count == QUEUE_MAX_CHANNEL_POLICIES) {
+        pthread_mutex_unlock(&queue->mutex);
+        return -1;
+    }
+    QueueChannelPolicy* entry = &queue->channel_policies[queue->channel_policy_count++];
+    snprintf(entry->channel, sizeof(entry->channel), "%s", channel);
+    entry->policy = policy;
+    pthread_mutex_unlock(&queue->mutex);
+    return 0;
+}
+
+// 在指定位置写入全部数据
+static int spill_write_at(int fd, const unsigned char* data, size_t length, off_t offset) {
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = pwrite(fd, data + done, length - done, offset + done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            seedlink_log(LOG_ERROR, "写入溢写文件失败: %s", strerror(errno));
+            return -1;
+        }
+        done += n;
+    }
+    return 0;
+}
+
+// 打开溢写文件。已有的文件不清空：核对文件头，从记录的读取位置起逐条检查剩余记录，
+// 截掉不完整的尾部，剩余记录在消费者出队时按顺序放回队列
+int queue_set_spill_file(DataQueue* queue, const char* path, uint32_t layout) {
+    size_t header_len = offsetof(QueueSlot, data);
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        seedlink_log(LOG_ERROR, "无法打开溢写文件 %s: %s", path, strerror(errno));
+        return -1;
+    }
+    unsigned char* stage = (unsigned char*)malloc(QUEUE_SPILL_BUFFER_SIZE);
+    struct stat st;
+    if (!stage || fstat(fd, &st) < 0) {
+        free(stage);
+        close(fd);
+        return -1;
+    }
     
-    strncpy(node->network, network, 2);
-    strncpy(node->station, station, 5);
-    strncpy(node->location, location, 2);
-    strncpy(node->channel, channel, 3);
-    memcpy(node->data, data, 512);
-    node->next = NULL;
+    QueueSpillHeader header;
+    off_t read_offset = sizeof(header), end = sizeof(header);
+    size_t records = 0;
+    if (st.st_size >= (off_t)sizeof(header) &&
+        pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+        memcmp(header.magic, QUEUE_SPILL_MAGIC, sizeof(header.magic)) == 0 &&
+        header.read_offset >= sizeof(header) && (off_t)header.read_offset <= st.st_size) {
+        read_offset = end = (off_t)header.read_offset;
+        QueueSlot slot;
+        while (end + (off_t)header_len <= st.st_size &&
+               pread(fd, &slot, header_len, end) == (ssize_t)header_len &&
+               slot.length <= queue->slot_size &&
+               end + (off_t)(header_len + slot.length) <= st.st_size) {
+            end += header_len + slot.length;
+            records++;
+        }
+    } else if (st.st_size > 0) {
+        seedlink_log(LOG_WARN, "溢写文件 %s 格式无效，已清空", path);
+    }
     
-    pthread_mutex_lock(&queue->mutex);
-    if (!queue->rear) {
-        queue->front = queue->rear = node;
-    } else {
-        queue->rear->next = node;
-        queue->rear = node;
+    // 剩余的记录按写入时的布局划分（例如按分片数取模），布局变了放回就会进入错误的队列
+    if (records > 0 && header.layout != layout) {
+        seedlink_log(LOG_ERROR, "溢写文件 %s 中有%zu条记录，写入时的布局为%u，与当前的%u不同，拒绝加载",
+                     path, records, header.layout, layout);
+        free(stage);
+        close(fd);
+        return -1;
+    }
+    
+    if (end != st.st_size || read_offset == end) {
+        memcpy(header.magic, QUEUE_SPILL_MAGIC, sizeof(header.magic));
+        header.layout = layout;
+        header.reserved = 0;
+        if (read_offset == end) read_offset = end = sizeof(header);
+        header.read_offset = (uint64_t)read_offset;
+        if (ftruncate(fd, end) < 0 ||
+            spill_write_at(fd, (const unsigned char*)&header, sizeof(header), 0) < 0) {
+            seedlink_log(LOG_ERROR, "无法初始化溢写文件 %s: %s", path, strerror(errno));
+            free(stage);
+            close(fd);
+            return -1;
+        }
     }
-    queue->size++;
-    pthread_cond_signal(&queue->not_empty);
+    if (records > 0) {
+        seedlink_log(LOG_INFO, "溢写文件 %s 中有%zu条上次未处理的记录，将按顺序放回队列", path, records);
+    }
+    
+    pthread_mutex_lock(&queue->mutex);
+    if (queue->spill_fd >= 0) close(queue->spill_fd);
+    free(queue->spill_stage);
+    queue->spill_fd = fd;
+    queue->spill_layout = layout;
+    queue->spill_stage = stage;
+    queue->spill_stage_len = 0;
+    queue->spill_write_offset = end;
+    queue->spill_read_offset = read_offset;
+    queue->spill_file_records = records;
+    queue->spill_pending += records;
     pthread_mutex_unlock(&queue->mutex);
+    return 0;
+}
+
+static QueuePolicy policy_for(const DataQueue* queue, const MiniSeedInfo* info) {
+    for (int i = 0; i < queue->channel_policy_count; i++) {
+        if (miniseed_wildcard_match(queue->channel_policies[i].channel, info->channel)) {
+            return queue->channel_policies[i].policy;
+        }
+    }
+    return queue->policy;
+}
+
+static int same_channel(const MiniSeedInfo* a, const MiniSeedInfo* b) {
+    return strcmp(a->channel, b->channel) == 0 && strcmp(a->station, b->station) == 0 &&
+           strcmp(a->network, b->network) == 0 && strcmp(a->location, b->location) == 0;
+}
+
+// 为drop-oldest的新记录腾出一个槽位（调用时持有锁）：丢弃最早的一条可丢弃的记录，
+// 即所在通道也是drop-oldest策略，或与新记录是同一通道；其前面的记录整体后移一格。
+// 阻塞或溢写策略通道的记录不会被其他通道挤掉，找不到可丢弃的记录时返回-1，由调用者丢弃新记录
+static int evict_oldest(DataQueue* queue, const MiniSeedInfo* info) {
+    size_t head = queue->head;
+    size_t tail = queue->tail;
+    size_t victim = head;
+    for (; victim != tail; victim++) {
+        const QueueSlot* slot = slot_at(queue, victim);
+        if (same_channel(&slot->info, info) || policy_for(queue, &slot->info) == QUEUE_POLICY_DROP_OLDEST) break;
+    }
+    if (victim == tail) return -1;
     
+    for (size_t i = victim; i != head; i--) {
+        const QueueSlot* src = slot_at(queue, i - 1);
+        memcpy(slot_at(queue, i), src, slot_bytes(src));
+    }
+    queue->head = head + 1;
     return 0;
 }
 
-int queue_pop(DataQueue* queue, char* network, char* station,
-             char* location, char* channel, unsigned char* data) {
-    pthread_mutex_lock(&queue->mutex);
-    while (queue->size == 0) {
-        pthread_cond_wait(&queue->not_empty, &queue->mutex);
+// 追加一条记录到溢写块（调用时持有锁，不做磁盘读写），格式与槽位相同：记录头加实际数据；
+// 当前块写满时换一个空块，块数达到上限时返回-1，由调用者等待消费者腾出空块
+static int spill_write(DataQueue* queue, const QueueRecord* record) {
+    size_t header_len = offsetof(QueueSlot, data);
+    size_t need = header_len + record->length;
+    QueueSpillBlock* block = queue->spill_tail;
+    
+    if (!block || block->length + need > QUEUE_SPILL_BUFFER_SIZE) {
+        block = queue->spill_free;
+        if (block) {
+            queue->spill_free = block->next;
+        } else if (queue->spill_blocks < QUEUE_SPILL_BUFFERS &&
+                   (block = (QueueSpillBlock*)malloc(sizeof(QueueSpillBlock))) != NULL) {
+            queue->spill_blocks++;
+        } else {
+            return -1;
+        }
+        block->next = NULL;
+        block->length = block->read = block->records = 0;
+        if (queue->spill_tail) queue->spill_tail->next = block;
+        else queue->spill_head = block;
+        queue->spill_tail = block;
+    }
+    
+    QueueSlot header;
+    header.length = (uint32_t)record->length;
+    header.info = *record->info;
+    memcpy(block->data + block->length, &header, header_len);
+    memcpy(block->data + block->length + header_len, record->data, record->length);
+    block->length += need;
+    block->records++;
+    queue->spill_pending++;
+    queue->spilled++;
+    return 0;
+}
+
+// 文件中的记录都已放回时，直接从内存块按顺序放回队列的空位（持有锁，不做磁盘读写）
+static void spill_reinject_memory(DataQueue* queue) {
+    size_t header_len = offsetof(QueueSlot, data);
+    size_t head = queue->head;
+    size_t tail = queue->tail;
+    
+    while (queue->spill_head) {
+        QueueSpillBlock* block = queue->spill_head;
+        if (block->read == block->length) {
+            if (block == queue->spill_tail) {
+                block->length = block->read = 0;
+                break;
+            }
+            queue->spill_head = block->next;
+            block->next = queue->spill_free;
+            queue->spill_free = block;
+            continue;
+        }
+        if (tail - head > queue->mask) break;
+        
+        QueueSlot* slot = slot_at(queue, tail++);
+        memcpy(slot, block->data + block->read, header_len);
+        memcpy(slot->data, block->data + block->read + header_len, slot->length);
+        block->read += header_len + slot->length;
+        block->records--;
+        queue->spill_pending--;
+        queue->reinjected++;
     }
+    queue->tail = tail;
+}
+
+// 放弃溢写文件中剩余的记录
+static void spill_discard_file(DataQueue* queue) {
+    seedlink_log(LOG_ERROR, "读取溢写文件失败，丢弃其中剩余的%zu条记录", queue->spill_file_records);
+    queue->dropped += queue->spill_file_records;
+    queue->spill_pending -= queue->spill_file_records;
+    queue->spill_file_records = 0;
+    queue->spill_read_offset = queue->spill_write_offset;
+}
+
+// 预读的数据中是否有一条完整的记录从读取位置开始
+static int spill_stage_ready(const DataQueue* queue) {
+    size_t header_len = offsetof(QueueSlot, data);
+    if (queue->spill_read_offset < queue->spill_stage_offset) return 0;
+    size_t pos = queue->spill_read_offset - queue->spill_stage_offset;
+    if (pos + header_len > queue->spill_stage_len) return 0;
+    const QueueSlot* slot = (const QueueSlot*)(queue->spill_stage + pos);
+    return pos + header_len + slot->length <= queue->spill_stage_len;
+}
+
+// 从溢写文件按顺序放回记录（持有锁，读写文件时释放锁）：锁外预读一段，
+// 锁内复制到队列的空位，再在锁外更新文件头中的读取位置；文件读完后清空
+static void spill_reinject_file(DataQueue* queue) {
+    size_t header_len = offsetof(QueueSlot, data);
+    int fd = queue->spill_fd;
     
-    QueueNode* node = queue->front;
-    strcpy(network, node->network);
-    strcpy(station, node->station);
-    strcpy(location, node->location);
-    strcpy(channel, node->channel);
-    memcpy(data, node->data, 512);
+    if (!spill_stage_ready(queue)) {
+        off_t offset = queue->spill_read_offset;
+        size_t want = queue->spill_write_offset - offset;
+        if (want > QUEUE_SPILL_BUFFER_SIZE) want = QUEUE_SPILL_BUFFER_SIZE;
+        pthread_mutex_unlock(&queue->mutex);
+        ssize_t n = pread(fd, queue->spill_stage, want, offset);
+        pthread_mutex_lock(&queue->mutex);
+        queue->spill_stage_offset = offset;
+        queue->spill_stage_len = n > 0 ? (size_t)n : 0;
+        if (!spill_stage_ready(queue)) {
+            spill_discard_file(queue);
+            queue->spill_stage_len = 0;
+        }
+    }
     
-    queue->front = node->next;
-    if (!queue->front) {
-        queue->rear = NULL;
+    size_t head = queue->head;
+    size_t tail = queue->tail;
+    while (queue->spill_file_records > 0 && tail - head <= queue->mask && spill_stage_ready(queue)) {
+        const unsigned char* src = queue->spill_stage + (queue->spill_read_offset - queue->spill_stage_offset);
+        const QueueSlot* record = (const QueueSlot*)src;
+        if (record->length > queue->slot_size) {
+            spill_discard_file(queue);
+            break;
+        }
+        memcpy(slot_at(queue, tail++), src, header_len + record->length);
+        queue->spill_read_offset += header_len + record->length;
+        queue->spill_file_records--;
+        queue->spill_pending--;
+        queue->reinjected++;
     }
-    queue->size--;
+    queue->tail = tail;
     
-    free(node);
+    // 记下读取位置，重启后不会再放回这些记录；文件读完后截断
+    QueueSpillHeader header;
+    memcpy(header.magic, QUEUE_SPILL_MAGIC, sizeof(header.magic));
+    header.layout = queue->spill_layout;
+    header.reserved = 0;
+    int drained = queue->spill_file_records == 0;
+    if (drained) {
+        queue->spill_read_offset = queue->spill_write_offset = sizeof(header);
+        queue->spill_stage_len = 0;
+    }
+    header.read_offset = (uint64_t)queue->spill_read_offset;
     pthread_mutex_unlock(&queue->mutex);
+    if (drained && ftruncate(fd, sizeof(header)) < 0) {
+        seedlink_log(LOG_WARN, "清空溢写文件失败: %s", strerror(errno));
+    }
+    spill_write_at(fd, (const unsigned char*)&header, sizeof(header), 0);
+    pthread_mutex_lock(&queue->mutex);
+}
+
+// 把生产者已写满的块按顺序追加到溢写文件（持有锁，写入时释放锁）；已开始从内存放回的块不再写入
+static void spill_write_blocks(DataQueue* queue) {
+    QueueSpillBlock* block;
+    while ((block = queue->spill_head) != NULL && block != queue->spill_tail && block->read == 0) {
+        queue->spill_head = block->next;
+        off_t offset = queue->spill_write_offset;
+        pthread_mutex_unlock(&queue->mutex);
+        int rc = spill_write_at(queue->spill_fd, block->data, block->length, offset);
+        pthread_mutex_lock(&queue->mutex);
+        
+        // 写入失败的块留在内存中，之后直接从内存放回
+        if (rc < 0) {
+            block->next = queue->spill_head;
+            queue->spill_head = block;
+            break;
+        }
+        queue->spill_write_offset += block->length;
+        queue->spill_file_records += block->records;
+        block->next = queue->spill_free;
+        queue->spill_free = block;
+    }
+}
+
+// 消费者处理溢写（调用时持有锁，磁盘读写期间释放锁，同一时间只有一个消费者进行）：
+// 先按顺序放回记录，文件中还有记录时从文件读，否则直接从内存块读；再把写满的块写入文件
+static void spill_service(DataQueue* queue) {
+    if (queue->spill_busy || queue->spill_pending == 0) return;
+    queue->spill_busy = 1;
+    if (queue->spill_file_records > 0) spill_reinject_file(queue);
+    else spill_reinject_memory(queue);
+    spill_write_blocks(queue);
+    queue->spill_busy = 0;
     
-    return 0;
+    // 放回了记录时唤醒其他等待的消费者，腾出了溢写块时唤醒等待的生产者
+    if (queue->tail != queue->head && queue->waiting_consumers > 0) {
+        pthread_cond_broadcast(&queue->not_empty);
+    }
+    if (queue->spill_free && queue->waiting_producers > 0) {
+        pthread_cond_broadcast(&queue->not_full);
+    }
+}
+
+// 唤醒等待的消费者（调用时持有锁）
+static void wake_consumers(DataQueue* queue, size_t pushed) {
+    if (queue->waiting_consumers == 0) return;
+    if (pushed > 1) {
+        pthread_cond_broadcast(&queue->not_empty);
+    } else {
+        pthread_cond_signal(&queue->not_empty);
+    }
 }
 
-int queue_size(DataQueue* queue) {
+// 溢写一条记录（调用时持有锁）；溢写块都在等待写入文件时阻塞，直到消费者腾出一块或队列关闭，
+// 不丢弃记录。unwoken为本批中已入队但尚未唤醒消费者的记录数，返回前都会唤醒
+static int spill_push(DataQueue* queue, const QueueRecord* record, size_t unwoken) {
+    int rc;
+    while ((rc = spill_write(queue, record)) < 0 && !queue->closed && queue->spill_blocks > 0) {
+        wake_consumers(queue, unwoken + 1);
+        unwoken = 0;
+        queue->waiting_producers++;
+        pthread_cond_wait(&queue->not_full, &queue->mutex);
+        queue->waiting_producers--;
+    }
+    wake_consumers(queue, unwoken + 1);
+    return rc;
+}
+
+size_t queue_push_many(DataQueue* queue, const QueueRecord* records, size_t count) {
     pthread_mutex_lock(&queue->mutex);
-    int size = queue->size;
+    
+    size_t pushed = 0, woken = 0;
+    int need_wake = 0;      // 本批中队列由空变为非空
+    for (size_t i = 0; i < count && !queue->closed; i++) {
+        const QueueRecord* record = &records[i];
+        if (record->length > queue->slot_size) {
+            queue->dropped++;
+            continue;
+        }
+        
+        QueuePolicy policy = policy_for(queue, record->info);
+        if (policy == QUEUE_POLICY_SPILL && queue->spill_fd < 0) {
+            if (!queue->spill_warned) {
+                seedlink_log(LOG_WARN, "没有可用的溢写文件，队列满时丢弃新记录");
+                queue->spill_warned = 1;
+            }
+            policy = QUEUE_POLICY_DROP_NEWEST;
+        }
+        
+        // 还有记录在溢写中时继续溢写，保证顺序
+        if (policy == QUEUE_POLICY_SPILL && queue->spill_pending > 0) {
+            if (spill_push(queue, record, pushed - woken) == 0) {
+                pushed++;
+                woken = pushed;
+            } else {
+                queue->dropped++;
+            }
+            continue;
+        }
+        
+        size_t head = queue->head;
+        size_t tail = queue->tail;
+        if (tail - head > queue->mask) {
+            if (policy == QUEUE_POLICY_DROP_NEWEST) {
+                queue->dropped++;
+                continue;
+            }
+            if (policy == QUEUE_POLICY_SPILL) {
+                if (spill_push(queue, record, pushed - woken) == 0) {
+                    pushed++;
+                    woken = pushed;
+                } else {
+                    queue->dropped++;
+                }
+                continue;
+            }
+            if (policy == QUEUE_POLICY_DROP_OLDEST) {
+                queue->dropped++;
+                if (evict_oldest(queue, record->info) < 0) continue;
+            } else {
+                // 阻塞之前先唤醒消费者，否则可能互相等待
+                if (need_wake) {
+                    wake_consumers(queue, pushed - woken);
+                    woken = pushed;
+                    need_wake = 0;
+                }
+                queue->waiting_producers++;
+                while (tail - head > queue->mask && !queue->closed) {
+                    pthread_cond_wait(&queue->not_full, &queue->mutex);
+                    head = queue->head;
+                    tail = queue->tail;
+                }
+                queue->waiting_producers--;
+                if (queue->closed) break;
+            }
+        }
+        
+        if (head == tail) need_wake = 1;
+        QueueSlot* slot = slot_at(queue, tail);
+        slot->length = (uint32_t)record->length;
+        slot->info = *record->info;
+        memcpy(slot->data, record->data, record->length);
+        queue->tail = tail + 1;
+        pushed++;
+    }
+    
+    // 只有由空变为非空时才需要唤醒消费者
+    if (need_wake) wake_consumers(queue, pushed - woken);
     pthread_mutex_unlock(&queue->mutex);
-    return size;
-} 
\ No newline at end of file
+    return pushed;
+}
+
+// 计算超时的绝对时间
+static void deadline_after(struct timespec* ts, int timeout_ms) {
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    ts->tv_sec += timeout_ms / 1000;
+    ts->tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if (ts->tv_nsec >= 1000000000) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000;
+    }
+}
+
+int queue_pop_many(DataQueue* queue, QueueBatch* batch, size_t max, int timeout_ms) {
+    if (max > batch->capacity) max = batch->capacity;
+    batch->count = 0;
+    
+    pthread_mutex_lock(&queue->mutex);
+    if (queue->spill_pending > 0) spill_service(queue);
+    size_t head = queue->head;
+    size_t tail = queue->tail;
+    
+    if (head == tail && !queue->closed && timeout_ms != 0) {
+        struct timespec deadline;
+        if (timeout_ms > 0) deadline_after(&deadline, timeout_ms);
+        
+        queue->waiting_consumers++;
+        while (head == tail && !queue->closed && !(queue->spill_pending > 0 && !queue->spill_busy)) {
+            int rc = timeout_ms > 0
+                   ? pthread_cond_timedwait(&queue->not_empty, &queue->mutex, &deadline)
+                   : pthread_cond_wait(&queue->not_empty, &queue->mutex);
+            head = queue->head;
+            tail = queue->tail;
+            if (rc == ETIMEDOUT) break;
+        }
+        queue->waiting_consumers--;
+        if (head == tail && queue->spill_pending > 0) {
+            spill_service(queue);
+            head = queue->head;
+            tail = queue->tail;
+        }
+    }
+    
+    if (head == tail) {
+        int closed = queue->closed && queue->spill_pending == 0;
+        pthread_mutex_unlock(&queue->mutex);
+        return closed ? -1 : 0;
+    }
+    
+    int was_full = tail - head > queue->mask;
+    while (batch->count < max && head != tail) {
+        const QueueSlot* slot = slot_at(queue, head++);
+        memcpy(queue_batch_slot(batch, batch->count++), slot, slot_bytes(slot));
+    }
+    queue->head = head;
+    
+    // 腾出的空位先放回溢写的记录，写满的溢写块写入文件
+    if (queue->spill_pending > 0) spill_service(queue);
+    
+    // 只有由满变为不满时才需要唤醒生产者
+    head = queue->head;
+    tail = queue->tail;
+    if (was_full && tail - head <= queue->mask && queue->waiting_producers > 0) {
+        pthread_cond_broadcast(&queue->not_full);
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return (int)batch->count;
+}
+
+QueueBatch* queue_batch_create(const DataQueue* queue, size_t capacity) {
+    QueueBatch* batch = (QueueBatch*)malloc(sizeof(QueueBatch));
+    if (!batch) return NULL;
+    
+    batch->count = 0;
+    batch->capacity = capacity;
+    batch->slot_stride = queue->slot_stride;
+    batch->slots = (unsigned char*)aligned_alloc(QUEUE_CACHE_LINE, capacity * queue->slot_stride);
+    if (!batch->slots) {
+        free(batch);
+        return NULL;
+    }
+    return batch;
+}
+
+void queue_batch_destroy(QueueBatch* batch) {
+    if (!batch) return;
+    free(batch->slots);
+    free(batch);
+}
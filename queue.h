@@ -1,35 +1,156 @@
 #ifndef QUEUE_H
 #define QUEUE_H
 
+#include <stddef.h>
+#include <stdint.h>
 #include <pthread.h>
+#include <sys/types.h>
 #include "miniseed.h"
 
-// 队列节点结构
-typedef struct QueueNode {
-    char network[3];
-    char station[6];
-    char location[3];
-    char channel[4];
-    unsigned char data[512];  // miniSEED数据
-    struct QueueNode* next;
-} QueueNode;
-
-// 队列结构
+#define QUEUE_CACHE_LINE 64
+#define QUEUE_DEFAULT_CAPACITY 4096     // 默认槽位数（2的幂）
+#define QUEUE_MAX_CHANNEL_POLICIES 16   // 按通道指定的策略条数
+#define QUEUE_SPILL_BUFFER_SIZE (256 * 1024)  // 溢写块的大小，也是从溢写文件预读的长度
+#define QUEUE_SPILL_BUFFERS 16          // 最多同时缓存的溢写块数，都写满时丢弃新记录
+#define QUEUE_SPILL_MAGIC "MSSPILL2"
+
+// 队列槽位：解码后的记录头加原始记录，数据区大小在创建队列时确定
+typedef struct {
+    uint32_t length;            // 记录实际长度
+    MiniSeedInfo info;          // 台站、通道和时间信息
+    unsigned char data[];       // miniSEED数据
+} QueueSlot;
+
+// 队列满时的处理策略
+typedef enum {
+    QUEUE_POLICY_BLOCK,         // 阻塞生产者直到有空位
+    QUEUE_POLICY_DROP_OLDEST,   // 丢弃队列中最早的同通道或drop-oldest通道的记录
+    QUEUE_POLICY_DROP_NEWEST,   // 丢弃新到的记录
+    QUEUE_POLICY_SPILL          // 顺序写入溢写文件，消费者赶上后再按顺序放回队列
+} QueuePolicy;
+
+// 按通道代码指定的策略，支持?和*通配符
+typedef struct {
+    char channel[12];
+    QueuePolicy policy;
+} QueueChannelPolicy;
+
+// 溢写块：生产者在锁内按顺序追加记录（只是内存复制），消费者在锁外写入溢写文件
+typedef struct QueueSpillBlock {
+    struct QueueSpillBlock* next;
+    size_t length;              // 已追加的字节数
+    size_t read;                // 已直接放回队列的字节数
+    size_t records;             // 尚未放回的记录数
+    unsigned char data[QUEUE_SPILL_BUFFER_SIZE];
+} QueueSpillBlock;
+
+// 溢写文件头（24字节），之后是按顺序追加的记录，格式与槽位相同：记录头加实际数据
+typedef struct {
+    char magic[8];
+    uint32_t layout;            // 写入者的布局（如存档分片数），不一致时拒绝加载剩余的记录
+    uint32_t reserved;
+    uint64_t read_offset;       // 下一条待放回记录的位置，之前的记录都已放回队列
+} QueueSpillHeader;
+
+// 队列统计的快照
+typedef struct {
+    size_t depth;               // 队列中的记录数
+    size_t spill_pending;       // 溢写中（文件和内存块）的记录数
+    uint64_t dropped;
+    uint64_t spilled;
+} QueueStats;
+
+// 批量入队的一条记录
+typedef struct {
+    const MiniSeedInfo* info;
+    const unsigned char* data;
+    size_t length;
+} QueueRecord;
+
+// 批量出队的缓冲区，槽位布局与队列相同
+typedef struct {
+    size_t count;               // 本次取出的记录数
+    size_t capacity;
+    size_t slot_stride;
+    unsigned char* slots;
+} QueueBatch;
+
+// 有界环形队列
+// 槽位在创建时一次分配，入队出队都不分配内存。
+// 通过queue_push_many/queue_pop_many按批复制记录，每批只加一次锁（生产者和消费者都可以有多个），
+// 只有队列由空变为非空（或由满变为不满）且有线程等待时才唤醒
 typedef struct {
-    QueueNode* front;
-    QueueNode* rear;
-    pthread_mutex_t mutex;
+    size_t head;                // 消费者读取位置
+    size_t tail;                // 生产者写入位置
+    size_t mask;                // 槽位数减一
+    size_t slot_size;           // 每个槽位可容纳的记录长度
+    size_t slot_stride;         // 相邻槽位的间距，按缓存行对齐
+    unsigned char* slots;
+    
+    pthread_mutex_t mutex;      // 保护head、tail和以下字段
     pthread_cond_t not_empty;
-    int size;
+    pthread_cond_t not_full;
+    int waiting_consumers;
+    int waiting_producers;
+    int closed;                 // 关闭后不再接受入队，消费者取完剩余记录后返回-1
+    
+    // 队列满时的处理策略，未匹配通道策略的记录使用默认策略
+    QueuePolicy policy;
+    QueueChannelPolicy channel_policies[QUEUE_MAX_CHANNEL_POLICIES];
+    int channel_policy_count;
+    
+    // 溢写：队列满时生产者把记录按顺序追加到内存中的溢写块，持锁期间不做磁盘读写；
+    // 消费者出队时在锁外把写满的块追加到溢写文件，腾出空位后再按顺序放回队列（文件中的记录在前，内存块在后）。
+    // 有记录在溢写中时，溢写策略的新记录也进入溢写，保证顺序不变。
+    // 溢写文件在退出后保留，下次打开时从文件头记录的读取位置继续放回
+    int spill_fd;
+    uint32_t spill_layout;
+    QueueSpillBlock* spill_head;    // 尚未写入文件的块，生产者追加到最后一块
+    QueueSpillBlock* spill_tail;
+    QueueSpillBlock* spill_free;
+    int spill_blocks;               // 已分配的块数
+    int spill_busy;                 // 有消费者正在锁外读写溢写文件
+    int spill_warned;               // 已提示溢写文件不可用
+    off_t spill_write_offset;       // 文件中已写入的长度
+    off_t spill_read_offset;        // 下一条待放回记录的位置
+    size_t spill_file_records;      // 文件中尚未放回的记录数
+    size_t spill_pending;           // 溢写中（文件和内存块）的记录数
+    unsigned char* spill_stage;     // 消费者从文件预读的数据
+    off_t spill_stage_offset;
+    size_t spill_stage_len;
+    
+    // 统计
+    uint64_t dropped;
+    uint64_t spilled;
+    uint64_t reinjected;
 } DataQueue;
 
 // 函数声明
-DataQueue* queue_create(void);
+DataQueue* queue_create(size_t capacity, size_t slot_size);
 void queue_destroy(DataQueue* queue);
-int queue_push(DataQueue* queue, const char* network, const char* station,
-              const char* location, const char* channel, const unsigned char* data);
-int queue_pop(DataQueue* queue, char* network, char* station,
-             char* location, char* channel, unsigned char* data);
-int queue_size(DataQueue* queue);
+void queue_close(DataQueue* queue);
+
+// 设置队列满时的默认策略和按通道的策略；溢写策略需要先指定溢写文件，没有溢写文件时按drop-newest处理
+void queue_set_policy(DataQueue* queue, QueuePolicy policy);
+int queue_set_channel_policy(DataQueue* queue, const char* channel, QueuePolicy policy);
+int queue_set_spill_file(DataQueue* queue, const char* path, uint32_t layout);
+int queue_parse_policy(const char* name);
+
+size_t queue_size(DataQueue* queue);
+void queue_get_stats(DataQueue* queue, QueueStats* stats);
+
+// 一次加锁写入多条记录，队列满时按策略处理
+// 返回进入队列或溢写文件的条数；被丢弃的记录不计入，队列关闭后停止写入
+size_t queue_push_many(DataQueue* queue, const QueueRecord* records, size_t count);
+// 一次加锁取出最多max条记录到batch；队列为空时最多等待timeout_ms毫秒（-1表示一直等待）
+// 返回取出的条数，超时返回0，队列已关闭且为空时返回-1
+int queue_pop_many(DataQueue* queue, QueueBatch* batch, size_t max, int timeout_ms);
+
+QueueBatch* queue_batch_create(const DataQueue* queue, size_t capacity);
+void queue_batch_destroy(QueueBatch* batch);
+
+static inline QueueSlot* queue_batch_slot(const QueueBatch* batch, size_t index) {
+    return (QueueSlot*)(batch->slots + index * batch->slot_stride);
+}
 
-#endif 
\ No newline at end of file
+#endif
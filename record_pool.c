@@ -0,0 +1,120 @@
+#include <stdlib.h>
+#include <string.h>
+#include "record_pool.h"
+#include "seedlink.h"
+
+// 能放下length字节的最小大小类别，超出最大类别时返回-1
+static int size_class(size_t length) {
+    size_t size = RECORD_POOL_MIN_SIZE;
+    for (int i = 0; i < RECORD_POOL_CLASSES; i++, size <<= 1) {
+        if (length <= size) return i;
+    }
+    return -1;
+}
+
+RecordPool* record_pool_create(void) {
+    RecordPool* pool = (RecordPool*)calloc(1, sizeof(RecordPool));
+    if (!pool) return NULL;
+    if (pthread_mutex_init(&pool->mutex, NULL) != 0) {
+        free(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+// 为一种大小分配一整块记录并加入空闲链表，需持有锁
+static int grow(RecordPool* pool, int cls) {
+    size_t stride = (sizeof(SharedRecord) + ((size_t)RECORD_POOL_MIN_SIZE << cls) + 63) & ~(size_t)63;
+
+    if (pool->slab_count == pool->slab_capacity) {
+        size_t capacity = pool->slab_capacity ? pool->slab_capacity * 2 : 16;
+        void** slabs = (void**)realloc(pool->slabs, capacity * sizeof(void*));
+        if (!slabs) return -1;
+        pool->slabs = slabs;
+        pool->slab_capacity = capacity;
+    }
+
+    unsigned char* slab = (unsigned char*)aligned_alloc(64, stride * RECORD_POOL_SLAB_RECORDS);
+    if (!slab) return -1;
+    pool->slabs[pool->slab_count++] = slab;
+
+    for (int i = RECORD_POOL_SLAB_RECORDS - 1; i >= 0; i--) {
+        SharedRecord* record = (SharedRecord*)(slab + i * stride);
+        record->size_class = (uint8_t)cls;
+        record->pool = pool;
+        record->next_free = pool->free_lists[cls];
+        pool->free_lists[cls] = record;
+    }
+    return 0;
+}
+
+// 取一个记录并复制数据，引用计数为1
+SharedRecord* record_pool_alloc(RecordPool* pool, const unsigned char* data, size_t length) {
+    int cls = size_class(length);
+    if (cls < 0) {
+        seedlink_log(LOG_WARN, "记录过长 (%zu字节)，无法放入记录池", length);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    if (!pool->free_lists[cls] && grow(pool, cls) < 0) {
+        pthread_mutex_unlock(&pool->mutex);
+        return NULL;
+    }
+    SharedRecord* record = pool->free_lists[cls];
+    pool->free_lists[cls] = record->next_free;
+    pool->allocs++;
+    pool->in_use++;
+    if (pool->in_use > pool->peak_in_use) pool->peak_in_use = pool->in_use;
+    pthread_mutex_unlock(&pool->mutex);
+
+    atomic_init(&record->refs, 1);
+    record->length = (uint32_t)length;
+    memcpy(record->data, data, length);
+    return record;
+}
+
+void record_ref(SharedRecord* record) {
+    atomic_fetch_add_explicit(&record->refs, 1, memory_order_relaxed);
+}
+
+void record_unref(SharedRecord* record) {
+    record_unref_many(&record, 1);
+}
+
+// 批量释放引用（记录须来自同一个记录池），引用计数归零的记录一次加锁归还
+void record_unref_many(SharedRecord* const records[], int count) {
+    SharedRecord* head = NULL;
+    RecordPool* pool = NULL;
+    int freed = 0;
+
+    for (int i = 0; i < count; i++) {
+        SharedRecord* record = records[i];
+        if (atomic_fetch_sub_explicit(&record->refs, 1, memory_order_acq_rel) != 1) continue;
+        record->next_free = head;
+        head = record;
+        pool = record->pool;
+        freed++;
+    }
+    if (!head) return;
+
+    pthread_mutex_lock(&pool->mutex);
+    while (head) {
+        SharedRecord* next = head->next_free;
+        head->next_free = pool->free_lists[head->size_class];
+        pool->free_lists[head->size_class] = head;
+        head = next;
+    }
+    pool->in_use -= freed;
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+void record_pool_destroy(RecordPool* pool) {
+    if (!pool) return;
+    for (size_t i = 0; i < pool->slab_count; i++) {
+        free(pool->slabs[i]);
+    }
+    free(pool->slabs);
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool);
+}
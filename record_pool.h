@@ -0,0 +1,48 @@
+#ifndef RECORD_POOL_H
+#define RECORD_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define RECORD_POOL_CLASSES 5           // 512、1024、2048、4096、8192字节五种大小
+#define RECORD_POOL_MIN_SIZE 512
+#define RECORD_POOL_SLAB_RECORDS 64     // 每次扩容分配的记录数
+
+struct RecordPool;
+
+// 共享的只读记录：写入后不再修改，按引用计数归还到记录池
+typedef struct SharedRecord {
+    atomic_int refs;
+    uint32_t length;
+    uint8_t size_class;
+    struct RecordPool* pool;
+    struct SharedRecord* next_free;
+    unsigned char data[];
+} SharedRecord;
+
+// 记录池：每种大小一个空闲链表，不够时整块（slab）扩容，已分配的内存不归还系统，
+// 稳定运行后分配和释放都只是链表操作。由mutex保护，批量归还时只加一次锁
+typedef struct RecordPool {
+    pthread_mutex_t mutex;
+    SharedRecord* free_lists[RECORD_POOL_CLASSES];
+    void** slabs;
+    size_t slab_count;
+    size_t slab_capacity;
+
+    // 统计
+    uint64_t allocs;
+    uint64_t in_use;
+    uint64_t peak_in_use;
+} RecordPool;
+
+// 函数声明
+RecordPool* record_pool_create(void);
+SharedRecord* record_pool_alloc(RecordPool* pool, const unsigned char* data, size_t length);
+void record_ref(SharedRecord* record);
+void record_unref(SharedRecord* record);
+void record_unref_many(SharedRecord* const records[], int count);
+void record_pool_destroy(RecordPool* pool);
+
+#endif
@@ -0,0 +1,123 @@
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "replay.h"
+
+#define DEFAULT_PORT 18000
+
+static ReplayCorpus g_corpus;
+static ReplayOptions g_options = { 0.0, 1 };
+
+// 客户端线程：处理一个SeedLink会话后关闭连接
+static void* client_thread(void* arg)
+{
+    int sockfd = (int)(intptr_t)arg;
+    replay_session(sockfd, &g_corpus, &g_options);
+    close(sockfd);
+    printf("[%s] 客户端断开连接\n", get_current_time());
+    return NULL;
+}
+
+static void usage(const char* prog)
+{
+    fprintf(stderr, "用法: %s [-p port] [-r packets_per_second] [-n loops] file.mseed...\n", prog);
+    fprintf(stderr, "  -r 0 表示尽可能快地发送，-n 0 表示无限循环\n");
+}
+
+int main(int argc, char* argv[])
+{
+    int port = DEFAULT_PORT;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "p:r:n:h")) != -1) {
+        switch (opt) {
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'r':
+                g_options.rate = atof(optarg);
+                break;
+            case 'n':
+                g_options.loops = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind >= argc || port <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (corpus_load(&g_corpus, &argv[optind], argc - optind) < 0) {
+        printf("[%s] 错误：没有可回放的记录\n", get_current_time());
+        corpus_free(&g_corpus);
+        return 1;
+    }
+
+    // 输出可能被重定向到文件，按行刷新便于观察
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    signal(SIGPIPE, SIG_IGN);
+
+    int server_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (server_fd < 0) {
+        printf("[%s] 错误：创建socket失败: %s\n", get_current_time(), strerror(errno));
+        corpus_free(&g_corpus);
+        return 1;
+    }
+
+    int reuse = 1;
+    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port);
+
+    if (bind(server_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(server_fd, SOMAXCONN) < 0) {
+        printf("[%s] 错误：监听端口 %d 失败: %s\n", get_current_time(), port, strerror(errno));
+        close(server_fd);
+        corpus_free(&g_corpus);
+        return 1;
+    }
+
+    if (g_options.rate > 0) {
+        printf("[%s] 回放服务器已启动，监听端口 %d，速率 %.1f 包/秒\n", get_current_time(), port, g_options.rate);
+    } else {
+        printf("[%s] 回放服务器已启动，监听端口 %d，不限速\n", get_current_time(), port);
+    }
+
+    while (1) {
+        struct sockaddr_in client_addr;
+        socklen_t addr_len = sizeof(client_addr);
+        int client_fd = accept(server_fd, (struct sockaddr*)&client_addr, &addr_len);
+        if (client_fd < 0) {
+            if (errno == EINTR) continue;
+            printf("[%s] 错误：接受连接失败: %s\n", get_current_time(), strerror(errno));
+            break;
+        }
+
+        int nodelay = 1;
+        setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+        printf("[%s] 新客户端连接: %s:%d\n", get_current_time(),
+               inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
+
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, client_thread, (void*)(intptr_t)client_fd) != 0) {
+            close(client_fd);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+
+    close(server_fd);
+    corpus_free(&g_corpus);
+    return 0;
+}
@@ -0,0 +1,413 @@
+#include <unistd.h>
+#include <errno.h>
+#include <ctype.h>
+#include <sys/socket.h>
+#include "replay.h"
+
+// 获取当前时间字符串的实现
+char* get_current_time(void) {
+    static __thread char buffer[32];
+    time_t rawtime;
+    struct tm timeinfo;
+
+    time(&rawtime);
+    localtime_r(&rawtime, &timeinfo);
+    strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &timeinfo);
+    return buffer;
+}
+
+// 按字节序读取16位整数
+static uint16_t read_u16(const unsigned char* p, int big_endian) {
+    return big_endian ? (uint16_t)((p[0] << 8) | p[1]) : (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t read_le32(const unsigned char* p) {
+    return p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// 复制定长字段并去除末尾空格
+static void copy_code(char* dst, size_t size, const unsigned char* src, size_t len) {
+    if (len >= size) len = size - 1;
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+    for (int i = (int)len - 1; i >= 0 && (dst[i] == ' ' || dst[i] == '\0'); i--) {
+        dst[i] = '\0';
+    }
+}
+
+// 识别一条记录，返回记录长度，无法识别时返回0
+static size_t parse_record(const unsigned char* data, size_t avail, ReplayRecord* rec) {
+    // miniSEED 3: 长度由固定头中的SID、扩展头和数据长度决定
+    if (avail >= 40 && data[0] == 'M' && data[1] == 'S' && data[2] == 3) {
+        size_t length = 40 + data[33] + read_u16(data + 34, 0) + read_le32(data + 36);
+        if (length > avail || length > REPLAY_MAX_RECORD) return 0;
+        
+        char sid[256];
+        memcpy(sid, data + 40, data[33]);
+        sid[data[33]] = '\0';
+        char* fields[6] = {0};
+        int count = 0;
+        char* p = strncmp(sid, "FDSN:", 5) == 0 ? sid + 5 : sid;
+        while (count < 6) {
+            fields[count++] = p;
+            p = strchr(p, '_');
+            if (!p) break;
+            *p++ = '\0';
+        }
+        if (count != 6) return 0;
+        
+        rec->format = '3';
+        snprintf(rec->network, sizeof(rec->network), "%s", fields[0]);
+        snprintf(rec->station, sizeof(rec->station), "%s", fields[1]);
+        snprintf(rec->location, sizeof(rec->location), "%s", fields[2]);
+        snprintf(rec->channel, sizeof(rec->channel), "%s%s%s", fields[3], fields[4], fields[5]);
+        return length;
+    }
+    
+    // miniSEED 2: 序列号为数字或空格，质量标识为D/R/Q/M
+    if (avail < 48) return 0;
+    for (int i = 0; i < 6; i++) {
+        if (!isdigit(data[i]) && data[i] != ' ') return 0;
+    }
+    if (!strchr("DRQM", data[6]) || data[6] == '\0') return 0;
+    
+    int big_endian = 1;
+    uint16_t year = read_u16(data + 20, 1);
+    if (year < 1900 || year > 2100) big_endian = 0;
+    
+    // 记录长度取自Blockette 1000，没有时按512字节
+    size_t length = 512;
+    uint16_t offset = read_u16(data + 46, big_endian);
+    for (int i = 0; i < data[39] && offset >= 48 && (size_t)offset + 8 <= avail; i++) {
+        if (read_u16(data + offset, big_endian) == 1000) {
+            length = (size_t)1 << data[offset + 6];
+            break;
+        }
+        offset = read_u16(data + offset + 2, big_endian);
+    }
+    if (length > avail || length > REPLAY_MAX_RECORD) return 0;
+    
+    rec->format = '2';
+    copy_code(rec->network, sizeof(rec->network), data + 18, 2);
+    copy_code(rec->station, sizeof(rec->station), data + 8, 5);
+    copy_code(rec->location, sizeof(rec->location), data + 13, 2);
+    copy_code(rec->channel, sizeof(rec->channel), data + 15, 3);
+    return length;
+}
+
+// 读取所有文件并切分成记录
+int corpus_load(ReplayCorpus* corpus, char* const files[], int file_count) {
+    memset(corpus, 0, sizeof(ReplayCorpus));
+    
+    for (int i = 0; i < file_count; i++) {
+        FILE* fp = fopen(files[i], "rb");
+        if (!fp) {
+            printf("[%s] 错误：无法打开文件 %s: %s\n", get_current_time(), files[i], strerror(errno));
+            return -1;
+        }
+        long size = fseek(fp, 0, SEEK_END) == 0 ? ftell(fp) : -1;
+        if (size < 0 || fseek(fp, 0, SEEK_SET) != 0) {
+            printf("[%s] 错误：无法读取文件 %s: %s\n", get_current_time(), files[i], strerror(errno));
+            fclose(fp);
+            return -1;
+        }
+        
+        unsigned char* buffer = realloc(corpus->buffer, corpus->size + size);
+        if (!buffer) {
+            fclose(fp);
+            return -1;
+        }
+        corpus->buffer = buffer;
+        corpus->size += fread(corpus->buffer + corpus->size, 1, size, fp);
+        fclose(fp);
+    }
+    
+    // 按512字节的记录估计初始容量，miniSEED 3的记录可能更短，不够时加倍
+    size_t capacity = corpus->size / 512 + 1;
+    corpus->records = malloc(capacity * sizeof(ReplayRecord));
+    if (!corpus->records) return -1;
+    
+    size_t offset = 0, skipped = 0;
+    while (offset < corpus->size) {
+        if (corpus->count == capacity) {
+            ReplayRecord* records = realloc(corpus->records, capacity * 2 * sizeof(ReplayRecord));
+            if (!records) return -1;
+            corpus->records = records;
+            capacity *= 2;
+        }
+        ReplayRecord* rec = &corpus->records[corpus->count];
+        size_t length = parse_record(corpus->buffer + offset, corpus->size - offset, rec);
+        if (length == 0) {
+            // 无法识别时按512字节跳过
+            offset += 512;
+            skipped++;
+            continue;
+        }
+        rec->data = corpus->buffer + offset;
+        rec->length = (uint32_t)length;
+        offset += length;
+        corpus->count++;
+    }
+    
+    printf("[%s] 加载了 %zu 条记录 (%zu 字节)，跳过 %zu 段无法识别的数据\n",
+           get_current_time(), corpus->count, corpus->size, skipped);
+    return corpus->count > 0 ? 0 : -1;
+}
+
+// 释放语料
+void corpus_free(ReplayCorpus* corpus) {
+    free(corpus->buffer);
+    free(corpus->records);
+    memset(corpus, 0, sizeof(ReplayCorpus));
+}
+
+// 通配符匹配：?匹配单个字符，*匹配任意长度
+static int wildcard_match(const char* pattern, const char* text) {
+    if (*pattern == '\0') return *text == '\0';
+    if (*pattern == '*') {
+        return wildcard_match(pattern + 1, text) || (*text && wildcard_match(pattern, text + 1));
+    }
+    if (*text && (*pattern == '?' || *pattern == *text)) {
+        return wildcard_match(pattern + 1, text + 1);
+    }
+    return 0;
+}
+
+// 记录是否符合会话的选择条件
+static int record_selected(const ReplayRecord* rec, const ReplayStation* stations, int station_count) {
+    for (int i = 0; i < station_count; i++) {
+        const ReplayStation* st = &stations[i];
+        if (!wildcard_match(st->network, rec->network) || !wildcard_match(st->station, rec->station)) {
+            continue;
+        }
+        if (st->selector_count == 0) return 1;
+        for (int j = 0; j < st->selector_count; j++) {
+            const ReplaySelector* sel = &st->selectors[j];
+            if ((sel->any_location || wildcard_match(sel->location, rec->location)) &&
+                wildcard_match(sel->channel, rec->channel)) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// 解析SELECT参数
+// v3: LLCCC.T 或 CCC.T；v4: LL_B_S_SS[.FT]
+static int parse_selector(const char* arg, int protocol, ReplaySelector* sel) {
+    char pattern[32];
+    snprintf(pattern, sizeof(pattern), "%s", arg);
+    char* dot = strchr(pattern, '.');
+    if (dot) *dot = '\0';
+    
+    memset(sel, 0, sizeof(ReplaySelector));
+    if (protocol == 4) {
+        char* parts[4];
+        int count = 0;
+        char* p = pattern;
+        while (count < 4) {
+            parts[count++] = p;
+            p = strchr(p, '_');
+            if (!p) break;
+            *p++ = '\0';
+        }
+        if (count != 4) return -1;
+        snprintf(sel->location, sizeof(sel->location), "%s", parts[0]);
+        snprintf(sel->channel, sizeof(sel->channel), "%s%s%s", parts[1], parts[2], parts[3]);
+        return 0;
+    }
+    
+    size_t len = strlen(pattern);
+    if (len == 3) {
+        sel->any_location = 1;
+        snprintf(sel->channel, sizeof(sel->channel), "%s", pattern);
+    } else if (len == 5) {
+        memcpy(sel->location, pattern, 2);
+        memcpy(sel->channel, pattern + 2, 4);
+        if (strcmp(sel->location, "--") == 0) sel->location[0] = '\0';
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+// 发送全部数据
+static int send_all(int sockfd, const void* data, size_t len) {
+    const unsigned char* p = (const unsigned char*)data;
+    while (len > 0) {
+        ssize_t n = send(sockfd, p, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int send_line(int sockfd, const char* line) {
+    return send_all(sockfd, line, strlen(line));
+}
+
+// 单调时钟秒数
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 按选择条件回放语料，序列号为 轮次*记录数+记录序号，从start_seq开始
+static void stream_records(int sockfd, const ReplayCorpus* corpus, const ReplayOptions* options,
+                           int protocol, const ReplayStation* stations, int station_count,
+                           uint64_t start_seq) {
+    unsigned char* buffer = malloc(REPLAY_SEND_BUFFER);
+    if (!buffer) return;
+    
+    size_t used = 0;
+    uint64_t sent = 0;
+    double start = now_seconds();
+    uint64_t seq = start_seq;
+    
+    while (options->loops == 0 || seq < (uint64_t)options->loops * corpus->count) {
+        const ReplayRecord* rec = &corpus->records[seq % corpus->count];
+        uint64_t this_seq = seq++;
+        
+        if (!record_selected(rec, stations, station_count)) continue;
+        // v3只能传输512字节的miniSEED 2记录
+        if (protocol == 3 && (rec->format != '2' || rec->length != 512)) continue;
+        
+        // 限速：未到发送时间时先发出已缓冲的数据再等待
+        if (options->rate > 0) {
+            double due = start + sent / options->rate;
+            double now = now_seconds();
+            if (now < due) {
+                if (used > 0 && send_all(sockfd, buffer, used) < 0) break;
+                used = 0;
+                struct timespec ts = {(time_t)(due - now), (long)((due - now - (time_t)(due - now)) * 1e9)};
+                nanosleep(&ts, NULL);
+            }
+        }
+        
+        size_t header_len = protocol == 4 ? 17 + strlen(rec->network) + 1 + strlen(rec->station) : 8;
+        if (used + header_len + rec->length > REPLAY_SEND_BUFFER) {
+            if (send_all(sockfd, buffer, used) < 0) break;
+            used = 0;
+        }
+        
+        unsigned char* p = buffer + used;
+        if (protocol == 4) {
+            // "SE" 格式 子格式 负载长度(4) 序列号(8) 台站ID长度(1) 台站ID
+            p[0] = 'S';
+            p[1] = 'E';
+            p[2] = rec->format;
+            p[3] = 'D';
+            for (int i = 0; i < 4; i++) p[4 + i] = (rec->length >> (8 * i)) & 0xFF;
+            for (int i = 0; i < 8; i++) p[8 + i] = (this_seq >> (8 * i)) & 0xFF;
+            p[16] = (unsigned char)(header_len - 17);
+            sprintf((char*)p + 17, "%s_%s", rec->network, rec->station);
+        } else {
+            char header[9];
+            snprintf(header, sizeof(header), "SL%06X", (unsigned)(this_seq & 0xFFFFFF));
+            memcpy(p, header, 8);
+        }
+        memcpy(p + header_len, rec->data, rec->length);
+        used += header_len + rec->length;
+        sent++;
+    }
+    
+    if (used > 0) send_all(sockfd, buffer, used);
+    free(buffer);
+    
+    double elapsed = now_seconds() - start;
+    printf("[%s] 回放结束: 发送 %llu 个包，用时 %.3f 秒 (%.0f 包/秒)\n", get_current_time(),
+           (unsigned long long)sent, elapsed, elapsed > 0 ? sent / elapsed : 0.0);
+}
+
+// 处理一个客户端会话：HELLO/SLPROTO/STATION/SELECT/DATA/END
+void replay_session(int sockfd, const ReplayCorpus* corpus, const ReplayOptions* options) {
+    ReplayStation* stations = calloc(REPLAY_MAX_STATIONS, sizeof(ReplayStation));
+    if (!stations) return;
+    
+    int station_count = 0;
+    int protocol = 3;
+    uint64_t start_seq = 0;
+    char buffer[4096];
+    size_t len = 0;
+    
+    while (1) {
+        ssize_t n = recv(sockfd, buffer + len, sizeof(buffer) - 1 - len, 0);
+        if (n <= 0) break;
+        len += n;
+        buffer[len] = '\0';
+        
+        char* line = buffer;
+        char* eol;
+        while ((eol = strpbrk(line, "\r\n")) != NULL) {
+            *eol = '\0';
+            char cmd[16] = {0}, arg1[64] = {0}, arg2[64] = {0};
+            int argc = sscanf(line, "%15s %63s %63s", cmd, arg1, arg2);
+            line = eol + 1;
+            if (argc <= 0) continue;
+            
+            for (char* c = cmd; *c; c++) *c = toupper((unsigned char)*c);
+            
+            if (strcmp(cmd, "HELLO") == 0) {
+                send_line(sockfd, "SeedLink v4.0 (replay) :: SLPROTO:4.0 SLPROTO:3.1\r\nreplay server\r\n");
+            } else if (strcmp(cmd, "SLPROTO") == 0) {
+                protocol = strncmp(arg1, "4", 1) == 0 ? 4 : 3;
+                send_line(sockfd, "OK\r\n");
+            } else if (strcmp(cmd, "STATION") == 0) {
+                if (station_count == REPLAY_MAX_STATIONS) {
+                    send_line(sockfd, "ERROR\r\n");
+                    continue;
+                }
+                ReplayStation* st = &stations[station_count++];
+                memset(st, 0, sizeof(ReplayStation));
+                char* underscore = strchr(arg1, '_');
+                if (protocol == 4 && underscore) {
+                    // v4: STATION NET_STA
+                    *underscore = '\0';
+                    snprintf(st->network, sizeof(st->network), "%s", arg1);
+                    snprintf(st->station, sizeof(st->station), "%s", underscore + 1);
+                } else {
+                    // v3: STATION STA [NET]
+                    snprintf(st->station, sizeof(st->station), "%s", arg1);
+                    snprintf(st->network, sizeof(st->network), "%s", argc > 2 ? arg2 : "*");
+                }
+                send_line(sockfd, "OK\r\n");
+            } else if (strcmp(cmd, "SELECT") == 0) {
+                ReplayStation* st = station_count > 0 ? &stations[station_count - 1] : NULL;
+                if (!st || st->selector_count == REPLAY_MAX_SELECTORS ||
+                    parse_selector(arg1, protocol, &st->selectors[st->selector_count]) < 0) {
+                    send_line(sockfd, "ERROR\r\n");
+                    continue;
+                }
+                st->selector_count++;
+                send_line(sockfd, "OK\r\n");
+            } else if (strcmp(cmd, "DATA") == 0) {
+                // 续传：v3为十六进制序列号，v4为十进制
+                if (argc > 1) {
+                    start_seq = strtoull(arg1, NULL, protocol == 4 ? 10 : 16);
+                }
+                send_line(sockfd, "OK\r\n");
+            } else if (strcmp(cmd, "END") == 0) {
+                printf("[%s] 开始回放: v%d %d 个台站，起始序列号 %llu\n", get_current_time(),
+                       protocol, station_count, (unsigned long long)start_seq);
+                stream_records(sockfd, corpus, options, protocol, stations, station_count, start_seq);
+                free(stations);
+                return;
+            } else if (strcmp(cmd, "BYE") == 0) {
+                free(stations);
+                return;
+            } else {
+                send_line(sockfd, "ERROR\r\n");
+            }
+        }
+        len -= line - buffer;
+        memmove(buffer, line, len);
+        if (len >= sizeof(buffer) - 1) break;
+    }
+    
+    free(stations);
+}
@@ -0,0 +1,61 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#define REPLAY_MAX_RECORD 8192      // 最大记录长度，与客户端一致
+#define REPLAY_MAX_STATIONS 64      // 每个会话最多选择的台站数
+#define REPLAY_MAX_SELECTORS 32     // 每个台站最多的SELECT条数
+#define REPLAY_SEND_BUFFER (64 * 1024)
+
+// 语料中的一条记录
+typedef struct {
+    const unsigned char* data;
+    uint32_t length;
+    char format;            // '2' 或 '3'
+    char network[9];
+    char station[9];
+    char location[9];
+    char channel[12];
+} ReplayRecord;
+
+// 从.mseed文件加载的全部记录，按文件顺序排列
+typedef struct {
+    unsigned char* buffer;
+    size_t size;
+    ReplayRecord* records;
+    size_t count;
+} ReplayCorpus;
+
+// 一条SELECT条件，支持?和*通配符
+typedef struct {
+    char location[9];
+    char channel[12];
+    int any_location;       // v3只给出通道码时匹配任意位置码
+} ReplaySelector;
+
+// 一个台站的选择条件，没有SELECT时选择全部通道
+typedef struct {
+    char network[9];
+    char station[9];
+    ReplaySelector selectors[REPLAY_MAX_SELECTORS];
+    int selector_count;
+} ReplayStation;
+
+// 回放参数
+typedef struct {
+    double rate;            // 每秒发送的包数，0表示尽可能快
+    int loops;              // 语料回放次数，0表示无限循环
+} ReplayOptions;
+
+// 函数声明
+char* get_current_time(void);
+int corpus_load(ReplayCorpus* corpus, char* const files[], int file_count);
+void corpus_free(ReplayCorpus* corpus);
+void replay_session(int sockfd, const ReplayCorpus* corpus, const ReplayOptions* options);
+
+#endif // REPLAY_H
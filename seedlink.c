@@ -8,63 +8,83 @@ static void print_hex(const unsigned char* data, size_t len) {
     printf("\n");
 }
 
-// 日志函数
-void seedlink_log(LogLevel level, const char* format, ...) {
-    time_t now;
-    struct tm *timeinfo;
-    char timestamp[20];
-    va_list args;
-    
-    time(&now);
-    timeinfo = localtime(&now);
-    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", timeinfo);
-    
-    fprintf(stderr, "[%s][%s] ", timestamp, 
-            level == LOG_DEBUG ? "DEBUG" :
-            level == LOG_INFO  ? "INFO"  :
-            level == LOG_WARN  ? "WARN"  : "ERROR");
-    
-    va_start(args, format);
-    vfprintf(stderr, format, args);
-    va_end(args);
-    fprintf(stderr, "\n");
-}
-
 // 创建SeedLink连接
 SeedLink* seedlink_create(const char* server, int port) {
     SeedLink* sl = (SeedLink*)malloc(sizeof(SeedLink));
     if (!sl) return NULL;
     
+    memset(sl, 0, sizeof(SeedLink));
+    sl->recv_buf = (unsigned char*)malloc(SEEDLINK_RECV_BUFFER_SIZE);
+    if (!sl->recv_buf) {
+        free(sl);
+        return NULL;
+    }
+    
     strncpy(sl->server_name, server, sizeof(sl->server_name)-1);
     sl->port = port;
     sl->sockfd = -1;
+    sl->protocol = 3;
+    sl->pipelined = 1;
+    sl->last_sequence = -1;
+    sl->checkpoint_sequence = -1;
+    sl->saved_sequence = -1;
+    sl->state = SL_STATE_DISCONNECTED;
     
     return sl;
 }
 
+// 设置要请求的台站和通道
+int seedlink_set_station(SeedLink* sl, const char* network, const char* station,
+                         const char* location, const char* channels[], int channel_count) {
+    if (channel_count <= 0 || channel_count > SEEDLINK_MAX_CHANNELS) {
+        seedlink_log(LOG_ERROR, "通道数量无效: %d", channel_count);
+        return -1;
+    }
+    
+    strncpy(sl->network, network, sizeof(sl->network)-1);
+    strncpy(sl->station, station, sizeof(sl->station)-1);
+    strncpy(sl->location, location, sizeof(sl->location)-1);
+    for (int i = 0; i < channel_count; i++) {
+        strncpy(sl->channels[i], channels[i], sizeof(sl->channels[i])-1);
+    }
+    sl->channel_count = channel_count;
+    
+    return 0;
+}
+
+// 用getaddrinfo解析服务器地址并缓存，之后的连接和重连都使用缓存的地址。
+// 解析可能阻塞，应在接收循环之外调用
+int seedlink_resolve(SeedLink* sl) {
+    struct addrinfo hints, *result;
+    char port[16];
+    
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(port, sizeof(port), "%d", sl->port);
+    
+    int rc = getaddrinfo(sl->server_name, port, &hints, &result);
+    if (rc != 0) {
+        seedlink_log(LOG_ERROR, "无法解析服务器域名 %s: %s", sl->server_name, gai_strerror(rc));
+        return -1;
+    }
+    memcpy(&sl->addr, result->ai_addr, result->ai_addrlen);
+    sl->addr_len = result->ai_addrlen;
+    freeaddrinfo(result);
+    return 0;
+}
+
 // 连接到服务器
 int seedlink_connect(SeedLink* sl) {
-    struct sockaddr_in server_addr;
-    struct hostent *server;
+    if (sl->addr_len == 0 && seedlink_resolve(sl) < 0) return -1;
     
-    sl->sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    sl->sockfd = socket(sl->addr.ss_family, SOCK_STREAM, 0);
     if (sl->sockfd < 0) {
         seedlink_log(LOG_ERROR, "无法创建socket: %s", strerror(errno));
         return -1;
     }
     
-    server = gethostbyname(sl->server_name);
-    if (!server) {
-        seedlink_log(LOG_ERROR, "无法解析服务器域名: %s", sl->server_name);
-        return -1;
-    }
-    
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(sl->port);
-    memcpy(&server_addr.sin_addr.s_addr, server->h_addr_list[0], server->h_length);
-    
-    if (connect(sl->sockfd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
+    if (connect(sl->sockfd, (struct sockaddr*)&sl->addr, sl->addr_len) < 0) {
         seedlink_log(LOG_ERROR, "连接失败: %s", strerror(errno));
         return -1;
     }
@@ -92,62 +112,348 @@ int seedlink_handshake(SeedLink* sl) {
     return 0;
 }
 
-// 请求多个通道的数据
-int seedlink_request_channels(SeedLink* sl, const char* network, const char* station,
-                            const char* location, const char* channels[], int channel_count) {
-    char cmd[256];
-    char buffer[1024];
-    int n;
-    
-    // 1. 首先发送STATION命令，指定台站
-    snprintf(cmd, sizeof(cmd), "STATION %s %s\r\n", station, network);
-    seedlink_log(LOG_INFO, "发送: %s", cmd);
-    if (send(sl->sockfd, cmd, strlen(cmd), 0) < 0) {
-        seedlink_log(LOG_ERROR, "发送STATION命令失败: %s", strerror(errno));
+// 将命令追加到发送缓冲区，并尽量立即发送
+static int queue_command(SeedLink* sl, const char* cmd) {
+    size_t len = strlen(cmd);
+    if (sl->out_len + len > sizeof(sl->out_buf)) {
+        seedlink_log(LOG_ERROR, "[%s.%s] 命令缓冲区已满", sl->network, sl->station);
         return -1;
     }
     
-    // 等待服务器响应
-    n = recv(sl->sockfd, buffer, sizeof(buffer)-1, 0);
-    if (n < 0) return -1;
-    buffer[n] = '\0';
-    seedlink_log(LOG_INFO, "服务器响应: %s", buffer);
+    seedlink_log(LOG_INFO, "[%s.%s] 发送: %.*s", sl->network, sl->station, (int)len - 2, cmd);
+    memcpy(sl->out_buf + sl->out_len, cmd, len);
+    sl->out_len += len;
+    return 0;
+}
+
+// 发送缓冲区中的命令，socket缓冲区满时保留剩余部分等待可写
+static int flush_commands(SeedLink* sl) {
+    while (sl->out_len > 0) {
+        ssize_t n = send(sl->sockfd, sl->out_buf, sl->out_len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            if (errno == EINTR) continue;
+            seedlink_log(LOG_ERROR, "[%s.%s] 发送命令失败: %s",
+                         sl->network, sl->station, strerror(errno));
+            return -1;
+        }
+        memmove(sl->out_buf, sl->out_buf + n, sl->out_len - n);
+        sl->out_len -= n;
+    }
+    return 0;
+}
+
+// 协商步骤总数：HELLO、[SLPROTO]、STATION、每个通道一个SELECT、DATA
+static int step_count(const SeedLink* sl) {
+    return (sl->protocol == 4 ? 4 : 3) + sl->channel_count;
+}
+
+// 第step步等待的响应对应的状态，SELECT步骤同时给出通道序号
+static SeedLinkState step_state(const SeedLink* sl, int step, int* channel) {
+    if (step == 0) return SL_STATE_HELLO;
+    if (sl->protocol == 4) {
+        if (step == 1) return SL_STATE_SLPROTO;
+        step--;
+    }
+    if (step == 1) return SL_STATE_STATION;
+    if (step - 2 < sl->channel_count) {
+        if (channel) *channel = step - 2;
+        return SL_STATE_SELECT;
+    }
+    return SL_STATE_DATA;
+}
+
+// 将第step步的命令加入发送缓冲区
+// v3: STATION STA NET / SELECT LLCCC.D
+// v4: STATION NET_STA / SELECT LL_B_S_SS（三字符通道拆成频带/源/子源）
+static int queue_step_command(SeedLink* sl, int step) {
+    char cmd[64];
+    int channel = 0;
+    const char* cha;
     
-    // 2. 循环发送SELECT命令，选择每个通道
-    for (int i = 0; i < channel_count; i++) {
-        snprintf(cmd, sizeof(cmd), "SELECT %s%s.D\r\n", location, channels[i]);
-        seedlink_log(LOG_INFO, "发送: %s", cmd);
-        if (send(sl->sockfd, cmd, strlen(cmd), 0) < 0) {
-            seedlink_log(LOG_ERROR, "发送SELECT命令失败: %s", strerror(errno));
+    switch (step_state(sl, step, &channel)) {
+        case SL_STATE_HELLO:
+            return queue_command(sl, "HELLO\r\n");
+        case SL_STATE_SLPROTO:
+            return queue_command(sl, "SLPROTO 4.0\r\n");
+        case SL_STATE_STATION:
+            if (sl->protocol == 4) {
+                snprintf(cmd, sizeof(cmd), "STATION %s_%s\r\n", sl->network, sl->station);
+            } else {
+                snprintf(cmd, sizeof(cmd), "STATION %s %s\r\n", sl->station, sl->network);
+            }
+            return queue_command(sl, cmd);
+        case SL_STATE_SELECT:
+            cha = sl->channels[channel];
+            if (sl->protocol == 4 && strlen(cha) == 3) {
+                snprintf(cmd, sizeof(cmd), "SELECT %s_%c_%c_%c\r\n", sl->location, cha[0], cha[1], cha[2]);
+            } else {
+                snprintf(cmd, sizeof(cmd), "SELECT %s%s.D\r\n", sl->location, cha);
+            }
+            return queue_command(sl, cmd);
+        default:
+            // 已知上次的序列号时从下一个包续传：v3为6位十六进制，v4为十进制
+            if (sl->last_sequence < 0) {
+                return queue_command(sl, "DATA\r\n");
+            }
+            if (sl->protocol == 4) {
+                snprintf(cmd, sizeof(cmd), "DATA %lld\r\n", (long long)sl->last_sequence + 1);
+            } else {
+                snprintf(cmd, sizeof(cmd), "DATA %06llX\r\n",
+                         (unsigned long long)(sl->last_sequence + 1) & 0xFFFFFF);
+            }
+            return queue_command(sl, cmd);
+    }
+}
+
+// 从第step步开始协商：逐条模式只发送当前命令，批量模式一次写入所有剩余命令和END
+static int start_negotiation(SeedLink* sl, int step) {
+    sl->step = step;
+    sl->hello_lines = 0;
+    sl->rejected_selects = 0;
+    sl->state = step_state(sl, step, NULL);
+    
+    if (!sl->pipelined) return queue_step_command(sl, step);
+    
+    for (int i = step; i < step_count(sl); i++) {
+        if (queue_step_command(sl, i) < 0) return -1;
+    }
+    return queue_command(sl, "END\r\n");
+}
+
+// 非阻塞方式发起连接，连接结果在socket可写时由seedlink_handle_io确认；
+// 使用seedlink_resolve缓存的地址，不在接收循环中解析域名
+int seedlink_connect_async(SeedLink* sl) {
+    if (sl->addr_len == 0) {
+        seedlink_log(LOG_ERROR, "服务器地址尚未解析: %s", sl->server_name);
+        return -1;
+    }
+    
+    sl->sockfd = socket(sl->addr.ss_family, SOCK_STREAM, 0);
+    if (sl->sockfd < 0) {
+        seedlink_log(LOG_ERROR, "无法创建socket: %s", strerror(errno));
+        return -1;
+    }
+    
+    int flags = fcntl(sl->sockfd, F_GETFL, 0);
+    if (flags < 0 || fcntl(sl->sockfd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        seedlink_log(LOG_ERROR, "设置非阻塞模式失败: %s", strerror(errno));
+        seedlink_close(sl);
+        return -1;
+    }
+    
+    sl->out_len = 0;
+    sl->recv_head = 0;
+    sl->recv_tail = 0;
+    
+    if (connect(sl->sockfd, (struct sockaddr*)&sl->addr, sl->addr_len) < 0 &&
+        errno != EINPROGRESS) {
+        seedlink_log(LOG_ERROR, "连接失败: %s", strerror(errno));
+        seedlink_close(sl);
+        return -1;
+    }
+    
+    sl->state = SL_STATE_CONNECTING;
+    return 0;
+}
+
+// 是否需要关注可写事件
+int seedlink_wants_write(const SeedLink* sl) {
+    return sl->state == SL_STATE_CONNECTING || sl->out_len > 0;
+}
+
+// 处理一行命令响应，推进协商状态机
+// 响应按命令顺序返回，第step步的响应对应第step条命令
+static int handle_response_line(SeedLink* sl, const char* line) {
+    int channel = 0;
+    
+    if (sl->state == SL_STATE_HELLO) {
+        // HELLO响应为两行：服务器版本和机构名称
+        seedlink_log(LOG_INFO, "[%s.%s] 服务器信息: %s", sl->network, sl->station, line);
+        if (sl->hello_lines == 0 && sl->protocol == 4 && !strstr(line, "SLPROTO:4")) {
+            seedlink_log(LOG_ERROR, "[%s.%s] 服务器不支持SeedLink v4", sl->network, sl->station);
             return -1;
         }
-        
-        // 等待服务器响应
-        n = recv(sl->sockfd, buffer, sizeof(buffer)-1, 0);
-        if (n < 0) return -1;
-        buffer[n] = '\0';
-        seedlink_log(LOG_INFO, "服务器响应: %s", buffer);
+        if (++sl->hello_lines < 2) return 0;
+    } else {
+        seedlink_log(LOG_INFO, "[%s.%s] 服务器响应: %s", sl->network, sl->station, line);
+        if (strncmp(line, "OK", 2) != 0) {
+            // 单个通道被拒绝时跳过该通道，其余命令被拒绝则放弃连接
+            if (sl->state != SL_STATE_SELECT) {
+                seedlink_log(LOG_ERROR, "[%s.%s] 服务器拒绝请求: %s",
+                             sl->network, sl->station, line);
+                return -1;
+            }
+            step_state(sl, sl->step, &channel);
+            seedlink_log(LOG_WARN, "[%s.%s] 服务器拒绝通道 %s%s: %s", sl->network, sl->station,
+                         sl->location, sl->channels[channel], line);
+            if (++sl->rejected_selects == sl->channel_count) {
+                seedlink_log(LOG_ERROR, "[%s.%s] 所有通道均被拒绝", sl->network, sl->station);
+                return -1;
+            }
+        }
+    }
+    
+    // DATA已确认，END之后服务器开始传输数据
+    if (++sl->step == step_count(sl)) {
+        sl->state = SL_STATE_STREAMING;
+        return sl->pipelined ? 0 : queue_command(sl, "END\r\n");
     }
     
-    // 3. 发送END命令，结束通道选择
-    const char* end_cmd = "END\r\n";
-    seedlink_log(LOG_INFO, "发送: %s", end_cmd);
-    if (send(sl->sockfd, end_cmd, strlen(end_cmd), 0) < 0) {
-        seedlink_log(LOG_ERROR, "发送END命令失败: %s", strerror(errno));
+    sl->state = step_state(sl, sl->step, NULL);
+    return sl->pipelined ? 0 : queue_step_command(sl, sl->step);
+}
+
+// 从socket读取数据到接收缓冲区
+// 返回读取的字节数，0表示暂无数据，-1表示出错或连接关闭
+static ssize_t fill_recv_buffer(SeedLink* sl) {
+    // 已处理完的数据直接丢弃；尾部空间不足一个数据包时，把剩余的不完整数据移到开头
+    if (sl->recv_head == sl->recv_tail) {
+        sl->recv_head = sl->recv_tail = 0;
+    } else if (SEEDLINK_RECV_BUFFER_SIZE - sl->recv_tail < SEEDLINK_MAX_PACKET_SIZE) {
+        memmove(sl->recv_buf, sl->recv_buf + sl->recv_head, sl->recv_tail - sl->recv_head);
+        sl->recv_tail -= sl->recv_head;
+        sl->recv_head = 0;
+    }
+    
+    while (1) {
+        ssize_t n = recv(sl->sockfd, sl->recv_buf + sl->recv_tail,
+                         SEEDLINK_RECV_BUFFER_SIZE - sl->recv_tail, 0);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            if (errno == EINTR) continue;
+            seedlink_log(LOG_ERROR, "[%s.%s] 读取数据失败: %s",
+                         sl->network, sl->station, strerror(errno));
+            return -1;
+        }
+        if (n == 0) {
+            seedlink_log(LOG_ERROR, "[%s.%s] 服务器关闭连接", sl->network, sl->station);
+            return -1;
+        }
+        sl->recv_tail += n;
+        return n;
+    }
+}
+
+// 处理缓冲区中完整的响应行
+static int consume_responses(SeedLink* sl) {
+    while (sl->state != SL_STATE_STREAMING && sl->recv_head < sl->recv_tail) {
+        unsigned char* line = sl->recv_buf + sl->recv_head;
+        size_t avail = sl->recv_tail - sl->recv_head;
+        unsigned char* eol = memchr(line, '\n', avail);
+        
+        if (!eol) {
+            if (avail >= BUFFER_SIZE) {
+                seedlink_log(LOG_ERROR, "[%s.%s] 响应行过长", sl->network, sl->station);
+                return -1;
+            }
+            return 0;
+        }
+        
+        sl->recv_head += eol - line + 1;
+        *eol = '\0';
+        if (eol > line && eol[-1] == '\r') eol[-1] = '\0';
+        if (handle_response_line(sl, (const char*)line) < 0) return -1;
+    }
+    return 0;
+}
+
+// 请求多个通道的数据（阻塞方式，需先完成seedlink_handshake）
+// STATION、SELECT、DATA和END一次发出，再依次校验各条响应；
+// 紧随响应到达的数据包保留在接收缓冲区中
+int seedlink_request_channels(SeedLink* sl, const char* network, const char* station,
+                            const char* location, const char* channels[], int channel_count) {
+    if (seedlink_set_station(sl, network, station, location, channels, channel_count) < 0) {
         return -1;
     }
     
-    // 4. 发送DATA命令，开始数据传输
-    const char* data_cmd = "DATA\r\n";
-    seedlink_log(LOG_INFO, "发送: %s", data_cmd);
-    if (send(sl->sockfd, data_cmd, strlen(data_cmd), 0) < 0) {
-        seedlink_log(LOG_ERROR, "发送DATA命令失败: %s", strerror(errno));
+    sl->recv_head = sl->recv_tail = 0;
+    sl->pipelined = 1;
+    if (start_negotiation(sl, sl->protocol == 4 ? 2 : 1) < 0 || flush_commands(sl) < 0) {
         return -1;
     }
     
+    while (sl->state != SL_STATE_STREAMING) {
+        if (fill_recv_buffer(sl) <= 0) return -1;
+        if (consume_responses(sl) < 0) return -1;
+    }
+    
+    return 0;
+}
+
+// 从缓冲区中取出所有完整的数据包交给回调，不完整的部分留到下次读取
+static int consume_packets(SeedLink* sl, SeedLinkPacketHandler handler, void* user) {
+    while (sl->recv_tail > sl->recv_head) {
+        const unsigned char* data = sl->recv_buf + sl->recv_head;
+        size_t avail = sl->recv_tail - sl->recv_head;
+        int length = seedlink_packet_length(data, avail);
+        
+        // 包头无效说明数据流失去同步，跳到下一个"SL"/"SE"重新对齐
+        if (length < 0) {
+            size_t skip = 1;
+            while (skip < avail && !(data[skip] == 'S' &&
+                   (skip + 1 == avail || data[skip+1] == 'L' || data[skip+1] == 'E'))) {
+                skip++;
+            }
+            seedlink_log(LOG_WARN, "[%s.%s] 数据流失去同步，丢弃%zu字节",
+                         sl->network, sl->station, skip);
+            sl->recv_head += skip;
+            continue;
+        }
+        if (length == 0 || (size_t)length > avail) break;
+        
+        SeedlinkPacket packet;
+        if (seedlink_parse_packet((const char*)data, &packet) == 0) {
+            sl->last_sequence = (int64_t)packet.sequence;
+            handler(sl, &packet, user);
+        }
+        sl->recv_head += length;
+    }
+    handler(sl, NULL, user);
+    return 0;
+}
+
+// 读取并处理数据：先处理命令响应，进入数据传输阶段后按包切分
+static int read_stream(SeedLink* sl, SeedLinkPacketHandler handler, void* user) {
+    for (int i = 0; i < SEEDLINK_MAX_READS_PER_EVENT; i++) {
+        size_t space = SEEDLINK_RECV_BUFFER_SIZE - sl->recv_tail;
+        ssize_t n = fill_recv_buffer(sl);
+        if (n < 0) return -1;
+        if (n == 0) return 0;
+        
+        if (consume_responses(sl) < 0) return -1;
+        if (sl->state == SL_STATE_STREAMING && consume_packets(sl, handler, user) < 0) return -1;
+        
+        // 没有读满说明socket中的数据已读完，不必再调用一次recv
+        if ((size_t)n < space && space >= SEEDLINK_MAX_PACKET_SIZE) return 0;
+    }
     return 0;
 }
 
+// 处理socket事件：完成连接、发送命令、读取响应和数据
+int seedlink_handle_io(SeedLink* sl, int readable, int writable,
+                       SeedLinkPacketHandler handler, void* user) {
+    if (sl->state == SL_STATE_CONNECTING) {
+        if (!writable) return 0;
+        
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if (getsockopt(sl->sockfd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) {
+            seedlink_log(LOG_ERROR, "[%s.%s] 连接 %s:%d 失败: %s", sl->network, sl->station,
+                         sl->server_name, sl->port, strerror(err ? err : errno));
+            return -1;
+        }
+        
+        seedlink_log(LOG_INFO, "[%s.%s] 已连接到 %s:%d", sl->network, sl->station,
+                     sl->server_name, sl->port);
+        if (start_negotiation(sl, 0) < 0) return -1;
+    }
+    
+    if (readable && read_stream(sl, handler, user) < 0) return -1;
+    
+    return flush_commands(sl);
+}
+
 // 获取数据格式描述
 static const char* get_format_description(char code) {
     switch(code) {
@@ -173,6 +479,45 @@ static const char* get_subformat_description(char code) {
     }
 }
 
+// 解析十六进制序列号，非法字符返回-1
+static int64_t parse_hex_sequence(const unsigned char* p, int len) {
+    int64_t value = 0;
+    for (int i = 0; i < len; i++) {
+        if (!isxdigit(p[i])) return -1;
+        value = value * 16 + (isdigit(p[i]) ? p[i] - '0' : toupper(p[i]) - 'A' + 10);
+    }
+    return value;
+}
+
+// 读取小端序32位整数
+static uint32_t read_le32(const unsigned char* p) {
+    return p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// 根据包头计算整个数据包的长度
+// 返回包长度，0表示头部还不完整，-1表示包头无效
+int seedlink_packet_length(const unsigned char* data, size_t avail) {
+    if (avail < 2) return 0;
+    if (data[0] != 'S') return -1;
+    
+    // v3: "SL" + 6位十六进制序列号 + 512字节miniSEED
+    if (data[1] == 'L') {
+        if (avail < SEEDLINK_V3_HEADER_SIZE) return 0;
+        if (parse_hex_sequence(data + 2, 6) < 0) return -1;
+        return SEEDLINK_V3_HEADER_SIZE + SEEDLINK_V3_PAYLOAD_SIZE;
+    }
+    
+    // v4: 负载长度和台站ID长度由包头给出
+    if (data[1] == 'E') {
+        if (avail < SEEDLINK_V4_HEADER_SIZE) return 0;
+        uint32_t payload_length = read_le32(data + 4);
+        if (payload_length == 0 || payload_length > MINISEED_MAX_RECORD_LENGTH) return -1;
+        return SEEDLINK_V4_HEADER_SIZE + data[16] + payload_length;
+    }
+    
+    return -1;
+}
+
 // 解析SeedLink数据包
 int seedlink_parse_packet(const char* buffer, SeedlinkPacket* packet) {
     if (!buffer || !packet) return -1;
@@ -185,30 +530,39 @@ int seedlink_parse_packet(const char* buffer, SeedlinkPacket* packet) {
     // print_hex(data, 8);
     
     // 1. Signature (2字节)
-    if (data[0] != 'S' || data[1] != 'L') {
+    if (data[0] != 'S' || (data[1] != 'L' && data[1] != 'E')) {
         seedlink_log(LOG_ERROR, "无效的SeedLink签名: %.2s", data);
         return -1;
     }
     
-    // 2. Data format (1字节)
-    char format = data[2];
-    
-    // 3. Subformat (1字节)
-    char subformat = data[3];
-    
-    // 4. Length of payload (4字节, little endian)
-    uint32_t payload_length = data[4] | (data[5] << 8) | 
-                             (data[6] << 16) | (data[7] << 24);
+    if (data[1] == 'L') {
+        // v3: 6位十六进制序列号，负载固定为512字节miniSEED 2
+        packet->version = 3;
+        packet->format = '2';
+        packet->subformat = 'D';
+        packet->sequence = (uint64_t)parse_hex_sequence(data + 2, 6);
+        packet->payload_length = SEEDLINK_V3_PAYLOAD_SIZE;
+        packet->header = (const SeedlinkHeader*)data;
+        packet->raw = data + SEEDLINK_V3_HEADER_SIZE;
+    } else {
+        // v4: 格式(1) 子格式(1) 负载长度(4, 小端) 序列号(8, 小端) 台站ID长度(1) 台站ID
+        packet->version = 4;
+        packet->format = data[2];
+        packet->subformat = data[3];
+        packet->payload_length = read_le32(data + 4);
+        packet->sequence = read_le32(data + 8) | ((uint64_t)read_le32(data + 12) << 32);
+        packet->header = NULL;
+        packet->raw = data + SEEDLINK_V4_HEADER_SIZE + data[16];
+    }
+    packet->mseed = packet->format == '2' ? (const MiniSeedHeader*)packet->raw : NULL;
     
     // 打印解析结果
-    seedlink_log(LOG_INFO, 
-        "数据包解析: 签名=SL 格式=%c(%s) 子格式=%c(%s) 负载长度=%u(0x%08X)",
-        format, get_format_description(format),
-        subformat, get_subformat_description(subformat),
-        payload_length, payload_length);
-    
-    // 复制512字节的miniSEED数据
-    memcpy(&packet->data, buffer + 8, 512);
+    seedlink_log(LOG_DEBUG, 
+        "数据包解析: v%d 序列号=%llu 格式=%c(%s) 子格式=%c(%s) 负载长度=%u",
+        packet->version, (unsigned long long)packet->sequence,
+        packet->format, get_format_description(packet->format),
+        packet->subformat, get_subformat_description(packet->subformat),
+        packet->payload_length);
     
     return 0;
 }
@@ -225,6 +579,7 @@ void seedlink_close(SeedLink* sl) {
 void seedlink_destroy(SeedLink* sl) {
     if (sl) {
         seedlink_close(sl);
+        free(sl->recv_buf);
         free(sl);
     }
 }
@@ -237,22 +592,9 @@ void trim_string(char* str) {
 }
 
 // 格式化miniSEED文件名
-void format_mseed_filename(const MiniSeedHeader* mseed, char* filename, size_t size) {
-    char net[3] = {0}, sta[6] = {0}, loc[3] = {0}, cha[4] = {0};
-    
-    // 复制并确保字符串正确终止
-    strncpy(net, mseed->network, 2);
-    strncpy(sta, mseed->station, 5);
-    strncpy(loc, mseed->location, 2);
-    strncpy(cha, mseed->channel, 3);
-    
-    // 去除字符串末尾的空格
-    trim_string(net);
-    trim_string(sta);
-    trim_string(loc);
-    trim_string(cha);
-    
-    // 构造文件名：network_station_location_channel.mseed
-    snprintf(filename, size, "%s_%s_%s_%s.mseed",
-             net, sta, loc, cha);
-} 
\ No newline at end of file
+void format_mseed_filename(const MiniSeedInfo* info, char* filename, size_t size) {
+    // 构造文件名：network_station_location_channel.mseed，miniSEED 3 使用 .mseed3
+    snprintf(filename, size, "%s_%s_%s_%s.%s",
+             info->network, info->station, info->location, info->channel,
+             info->format == 3 ? "mseed3" : "mseed");
+}
@@ -13,12 +13,22 @@
 #include <errno.h>
 #include <stdarg.h>
 #include <ctype.h>
+#include <fcntl.h>
 #include "miniseed.h"  // 包含miniSEED相关定义
+#include "logger.h"    // 日志函数
 
 #define BUFFER_SIZE 1024
 #define SEEDLINK_PORT 18000
 #define SEEDLINK_SERVER "rtserve.iris.washington.edu"
-#define SEEDLINK_PACKET_SIZE 520  // 8 bytes header + 512 bytes miniSEED
+#define SEEDLINK_PACKET_SIZE 520  // v3: 8 bytes header + 512 bytes miniSEED
+#define SEEDLINK_V3_HEADER_SIZE 8
+#define SEEDLINK_V3_PAYLOAD_SIZE 512
+#define SEEDLINK_V4_HEADER_SIZE 17  // v4: "SE"+格式+子格式+4字节长度+8字节序列号+1字节台站ID长度
+#define SEEDLINK_MAX_PACKET_SIZE (SEEDLINK_V4_HEADER_SIZE + 255 + MINISEED_MAX_RECORD_LENGTH)
+#define SEEDLINK_MAX_CHANNELS 64  // 每个台站最多选择的通道数
+#define SEEDLINK_OUT_BUFFER_SIZE 4096  // 待发送命令缓冲区大小
+#define SEEDLINK_RECV_BUFFER_SIZE (64 * 1024)  // 接收缓冲区大小，一次recv读取多个数据包
+#define SEEDLINK_MAX_READS_PER_EVENT 4  // 每次可读事件最多调用recv的次数
 
 // SeedLink头结构体
 typedef struct {
@@ -26,33 +36,76 @@ typedef struct {
     char sequence_number[6];    // 6位十六进制序列号
 } SeedlinkHeader;
 
-// SeedLink数据包结构体
+// SeedLink数据包结构体，各指针直接指向接收缓冲区，不复制数据
 typedef struct {
-    SeedlinkHeader header;     // 8字节头
-    union {
-        unsigned char raw[512];  // 原始数据
-        MiniSeedHeader mseed;    // 解析后的miniSEED头
-    } data;
+    int version;                    // 3: "SL"头，4: "SE"头
+    char format;                    // 数据格式：'2' miniSEED 2，'3' miniSEED 3
+    char subformat;                 // 子格式：'D' 数据等
+    uint64_t sequence;              // 包序列号
+    uint32_t payload_length;        // 负载长度
+    const SeedlinkHeader* header;   // v3的8字节头
+    const unsigned char* raw;       // 负载（原始miniSEED记录）
+    const MiniSeedHeader* mseed;    // 按miniSEED 2头解释的负载，仅format为'2'时有效
 } SeedlinkPacket;
 
+// SeedLink连接状态
+typedef enum {
+    SL_STATE_DISCONNECTED,  // 未连接
+    SL_STATE_CONNECTING,    // 非阻塞connect进行中
+    SL_STATE_HELLO,         // 等待HELLO的两行响应
+    SL_STATE_SLPROTO,       // 等待SLPROTO 4.0的响应
+    SL_STATE_STATION,       // 等待STATION的响应
+    SL_STATE_SELECT,        // 等待SELECT的响应
+    SL_STATE_DATA,          // 等待DATA的响应
+    SL_STATE_STREAMING      // 已发送END，接收数据包
+} SeedLinkState;
+
 // SeedLink连接结构体
 typedef struct {
     int sockfd;
     char server_name[256];
     int port;
+    struct sockaddr_storage addr;   // 解析后的服务器地址，重连时直接使用
+    socklen_t addr_len;             // 0表示尚未解析
+    int protocol;               // 协议版本：3 或 4
+
+    // 台站选择
+    char network[3];
+    char station[6];
+    char location[3];
+    char channels[SEEDLINK_MAX_CHANNELS][4];
+    int channel_count;
+
+    // 非阻塞状态机
+    SeedLinkState state;
+    int pipelined;              // 1: 所有协商命令一次发出；0: 逐条发送并等待响应
+    int step;                   // 当前等待响应的协商步骤
+    int hello_lines;            // 已收到的HELLO响应行数
+    int rejected_selects;       // 被服务器拒绝的SELECT数量
+    int64_t last_sequence;      // 最后收到的包序列号，-1表示未知；重连时从下一个包续传
+    int64_t checkpoint_sequence;    // 最近一次检查点时的last_sequence
+    int64_t saved_sequence;     // 已确认处理完（如已存档）的序列号，写入状态文件
+    char out_buf[SEEDLINK_OUT_BUFFER_SIZE];  // 待发送的命令
+    size_t out_len;
+
+    // 接收缓冲区：响应行和数据包共用，[recv_head, recv_tail) 为未处理数据
+    unsigned char* recv_buf;
+    size_t recv_head;
+    size_t recv_tail;
+
+    // 重连控制（由接收引擎管理）
+    int64_t connected_at_ms;    // 本次连接建立的时间
+    int64_t reconnect_at_ms;    // 下次重连的时间
+    int reconnect_delay_ms;     // 当前退避时间
 } SeedLink;
 
-// 日志级别
-typedef enum {
-    LOG_DEBUG,
-    LOG_INFO,
-    LOG_WARN,
-    LOG_ERROR
-} LogLevel;
+// 数据包回调：packet已解析，其中的指针指向接收缓冲区；
+// 一次读取的数据包都处理完后再以packet为NULL调用一次，在此之前这些指针都有效，回调可以攒批处理
+typedef void (*SeedLinkPacketHandler)(SeedLink* sl, const SeedlinkPacket* packet, void* user);
 
 // 函数声明
-void seedlink_log(LogLevel level, const char* format, ...);
 SeedLink* seedlink_create(const char* server, int port);
+int seedlink_resolve(SeedLink* sl);
 int seedlink_connect(SeedLink* sl);
 int seedlink_handshake(SeedLink* sl);
 int seedlink_request_channels(SeedLink* sl, 
@@ -61,10 +114,21 @@ int seedlink_request_channels(SeedLink* sl,
                             const char* location, 
                             const char* channels[], 
                             int channel_count);
+int seedlink_set_station(SeedLink* sl,
+                         const char* network,
+                         const char* station,
+                         const char* location,
+                         const char* channels[],
+                         int channel_count);
+int seedlink_connect_async(SeedLink* sl);
+int seedlink_wants_write(const SeedLink* sl);
+int seedlink_handle_io(SeedLink* sl, int readable, int writable,
+                       SeedLinkPacketHandler handler, void* user);
+int seedlink_packet_length(const unsigned char* data, size_t avail);
 int seedlink_parse_packet(const char* buffer, SeedlinkPacket* packet);
 void seedlink_close(SeedLink* sl);
 void seedlink_destroy(SeedLink* sl);
 void trim_string(char* str);
-void format_mseed_filename(const MiniSeedHeader* mseed, char* filename, size_t size);
+void format_mseed_filename(const MiniSeedInfo* info, char* filename, size_t size);
 
 #endif 
\ No newline at end of file
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE  // accept4
 #include "server.h"
 
 // 打印十六进制数据
@@ -18,56 +19,842 @@ static void print_hex_dump(const unsigned char* data, size_t size) {
     printf("\n");
 }
 
-// 客户端处理线程
-static void* client_handler(void* arg) {
-    ClientConnection* client = (ClientConnection*)arg;
+static const char* policy_names[] = { "drop-oldest", "disconnect", "pause" };
+
+// 解析客户端队列策略：策略名[:记录数]
+int server_parse_policy(const char* spec, ServerPolicy* policy, uint32_t* capacity) {
+    const char* colon = strchr(spec, ':');
+    size_t len = colon ? (size_t)(colon - spec) : strlen(spec);
+    
+    for (int i = 0; i < (int)(sizeof(policy_names) / sizeof(policy_names[0])); i++) {
+        if (strlen(policy_names[i]) == len && strncasecmp(spec, policy_names[i], len) == 0) {
+            *policy = (ServerPolicy)i;
+            if (colon) {
+                long n = atol(colon + 1);
+                if (n < 2) return -1;
+                *capacity = (uint32_t)n;
+            }
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// 设置客户端发送队列的策略和容量（向上取整为2的幂），只影响之后连接的客户端
+void server_set_client_policy(TCPServer* server, ServerPolicy policy, uint32_t capacity) {
+    uint32_t size = 2;
+    while (size < capacity) size <<= 1;
+    pthread_mutex_lock(&server->mutex);
+    server->policy = policy;
+    server->queue_capacity = size;
+    pthread_mutex_unlock(&server->mutex);
+}
+
+// 设置最近数据环保留的时长（秒），0为不保留，应在广播开始前调用
+void server_set_history(TCPServer* server, int seconds) {
+    pthread_mutex_lock(&server->mutex);
+    server->history_window = seconds > 0 ? (int64_t)seconds * 1000000000LL : 0;
+    pthread_mutex_unlock(&server->mutex);
+}
+
+// 把客户端放入待发送列表，需持有锁；返回是否需要唤醒事件循环
+static int schedule_client(TCPServer* server, ClientConnection* client) {
+    if (client->scheduled) return 0;
+    client->scheduled = 1;
+    server->ready[server->ready_count++] = client;
+    if (server->wake_pending) return 0;
+    server->wake_pending = 1;
+    return 1;
+}
+
+// 唤醒事件循环
+static void wake_loop(TCPServer* server) {
+    uint64_t one = 1;
+    if (write(server->wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        seedlink_log(LOG_ERROR, "唤醒服务器线程失败: %s", strerror(errno));
+    }
+}
+
+// 单调时钟毫秒数
+static int64_t monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// 把记录放入一个客户端的队列，需持有锁；返回是否需要唤醒事件循环
+static int enqueue_record(TCPServer* server, ClientConnection* client, SharedRecord* record) {
+    if (client->closing) return 0;
+    
+    if (client->count > client->mask) {
+        client->dropped++;
+        server->dropped++;
+        switch (server->policy) {
+            case SERVER_POLICY_DISCONNECT:
+                client->closing = 1;
+                server->slow_disconnects++;
+                return schedule_client(server, client);
+            case SERVER_POLICY_PAUSE:
+                client->paused = 1;
+                return 0;
+            default: {
+                // 队首正在发送或只发送了一部分的记录不能丢弃：丢弃它们之后最早的一条，
+                // 再把它们整体后移一格；全部都在发送中时丢弃新记录
+                uint32_t pinned = client->inflight ? client->inflight : (client->sent > 0);
+                if (pinned >= client->count) return 0;
+                uint32_t victim = client->head + pinned;
+                record_unref(client->queue[victim & client->mask]);
+                for (uint32_t i = victim; i != client->head; i--) {
+                    client->queue[i & client->mask] = client->queue[(i - 1) & client->mask];
+                }
+                client->head++;
+                client->count--;
+                break;
+            }
+        }
+    } else if (client->paused) {
+        client->dropped++;
+        server->dropped++;
+        return 0;
+    }
+    
+    record_ref(record);
+    client->queue[(client->head + client->count) & client->mask] = record;
+    client->count++;
+    return client->count == 1 ? schedule_client(server, client) : 0;
+}
+
+// 清空路由表（连同各通道的最近数据环），需持有锁
+static void clear_routes(TCPServer* server) {
+    for (size_t i = 0; i < SERVER_ROUTE_BUCKETS; i++) {
+        RouteEntry* entry = server->routes[i];
+        while (entry) {
+            RouteEntry* next = entry->next;
+            for (uint32_t j = 0; j < entry->history_count; j++) {
+                record_unref(entry->history[(entry->history_head + j) & entry->history_mask].record);
+            }
+            free(entry->history);
+            free(entry->subscribers);
+            free(entry);
+            entry = next;
+        }
+        server->routes[i] = NULL;
+    }
+    server->route_count = 0;
+}
+
+// 客户端是否订阅了该通道，没有订阅的客户端接收所有记录
+static int client_subscribes(const ClientConnection* client, const char* network, const char* station,
+                             const char* location, const char* channel) {
+    if (client->pattern_count == 0) return 1;
+    for (int i = 0; i < client->pattern_count; i++) {
+        if (miniseed_match_pattern(&client->patterns[i], network, station, location, channel)) return 1;
+    }
+    return 0;
+}
+
+static int route_subscribed(const ClientConnection* client, const RouteEntry* route) {
+    return client_subscribes(client, route->network, route->station, route->location, route->channel);
+}
+
+// 把客户端加入通道的订阅者列表，内存不足时返回-1
+static int route_add(RouteEntry* entry, ClientConnection* client) {
+    if (entry->count == entry->capacity) {
+        int capacity = entry->capacity ? entry->capacity * 2 : 8;
+        ClientConnection** subscribers = (ClientConnection**)realloc(entry->subscribers,
+                                                                     capacity * sizeof(ClientConnection*));
+        if (!subscribers) return -1;
+        entry->subscribers = subscribers;
+        entry->capacity = capacity;
+    }
+    entry->subscribers[entry->count++] = client;
+    return 0;
+}
+
+// 按客户端当前的订阅更新它在各通道订阅者列表中的位置，需持有锁；
+// connected为0时从所有列表中移除。只处理这一个客户端，其他客户端的路由不变
+static void route_update_client(TCPServer* server, ClientConnection* client, int connected) {
+    for (size_t i = 0; i < SERVER_ROUTE_BUCKETS; i++) {
+        for (RouteEntry* entry = server->routes[i]; entry; entry = entry->next) {
+            if (entry->stale) continue;
+            int found = -1;
+            for (int k = 0; k < entry->count; k++) {
+                if (entry->subscribers[k] == client) {
+                    found = k;
+                    break;
+                }
+            }
+            int wanted = connected && route_subscribed(client, entry);
+            if (wanted && found < 0) {
+                if (route_add(entry, client) < 0) entry->stale = 1;
+            } else if (!wanted && found >= 0) {
+                entry->subscribers[found] = entry->subscribers[--entry->count];
+            }
+        }
+    }
+}
+
+// 查找通道的订阅者列表，不存在或增量更新失败时按所有客户端的订阅重新计算，需持有锁；
+// 内存不足时返回NULL，由调用者逐个客户端匹配
+static RouteEntry* route_lookup(TCPServer* server, const MiniSeedInfo* info) {
+    uint64_t hash = miniseed_nslc_hash(info);
+    RouteEntry** bucket = &server->routes[hash & (SERVER_ROUTE_BUCKETS - 1)];
+    RouteEntry* entry = *bucket;
+    while (entry && !(entry->hash == hash && strcmp(entry->channel, info->channel) == 0 &&
+                      strcmp(entry->station, info->station) == 0 &&
+                      strcmp(entry->network, info->network) == 0 &&
+                      strcmp(entry->location, info->location) == 0)) {
+        entry = entry->next;
+    }
+    
+    if (!entry) {
+        if (server->route_count >= SERVER_ROUTE_MAX) clear_routes(server);
+        entry = (RouteEntry*)calloc(1, sizeof(RouteEntry));
+        if (!entry) return NULL;
+        entry->hash = hash;
+        memcpy(entry->network, info->network, sizeof(entry->network));
+        memcpy(entry->station, info->station, sizeof(entry->station));
+        memcpy(entry->location, info->location, sizeof(entry->location));
+        memcpy(entry->channel, info->channel, sizeof(entry->channel));
+        entry->stale = 1;
+        entry->next = *bucket;
+        *bucket = entry;
+        server->route_count++;
+    }
+    
+    if (entry->stale) {
+        entry->count = 0;
+        for (int i = 0; i < server->client_count; i++) {
+            if (route_subscribed(server->clients[i], entry) && route_add(entry, server->clients[i]) < 0) {
+                return NULL;
+            }
+        }
+        entry->stale = 0;
+        server->route_rebuilds++;
+    }
+    return entry;
+}
+
+// 把记录加入通道的最近数据环，需持有锁。先丢弃结束时间比这条记录早history_window以上的记录；
+// 环满时加倍，达到SERVER_HISTORY_RECORDS后丢弃最早的一条
+static void history_append(TCPServer* server, RouteEntry* route, SharedRecord* record,
+                           const MiniSeedInfo* info, uint64_t sequence) {
+    int64_t end_time = miniseed_end_time(info);
+    while (route->history_count > 0) {
+        HistoryRecord* oldest = &route->history[route->history_head & route->history_mask];
+        if (oldest->end_time > end_time - server->history_window) break;
+        record_unref(oldest->record);
+        route->history_head++;
+        route->history_count--;
+    }
+    
+    uint32_t size = route->history ? route->history_mask + 1 : 0;
+    if (route->history_count == size) {
+        uint32_t grow = size ? size * 2 : 16;
+        HistoryRecord* history = grow <= SERVER_HISTORY_RECORDS ?
+                                 (HistoryRecord*)malloc(grow * sizeof(HistoryRecord)) : NULL;
+        if (history) {
+            for (uint32_t i = 0; i < route->history_count; i++) {
+                history[i] = route->history[(route->history_head + i) & route->history_mask];
+            }
+            free(route->history);
+            route->history = history;
+            route->history_head = 0;
+            route->history_mask = grow - 1;
+        } else if (size > 0) {
+            record_unref(route->history[route->history_head & route->history_mask].record);
+            route->history_head++;
+            route->history_count--;
+        } else {
+            return;
+        }
+    }
+    
+    record_ref(record);
+    HistoryRecord* item = &route->history[(route->history_head + route->history_count) & route->history_mask];
+    item->record = record;
+    item->end_time = end_time;
+    item->sequence = sequence;
+    route->history_count++;
+}
+
+// 一个通道中待回放的记录，已按广播顺序排列
+typedef struct {
+    const HistoryRecord* items;
+    size_t count;
+} ReplayRun;
+
+// 一个通道回放的最后时间，拼接时据此跳过与回放重叠的实时记录
+typedef struct {
+    uint64_t hash;
+    int64_t end_time;
+} ReplayEnd;
+
+static int compare_replay_end(const void* a, const void* b) {
+    uint64_t x = ((const ReplayEnd*)a)->hash, y = ((const ReplayEnd*)b)->hash;
+    return (x > y) - (x < y);
+}
+
+// 已排队的实时记录是否与回放重叠：同一通道中结束时间不晚于回放的最后一条记录
+static int replay_overlaps(const SharedRecord* record, const ReplayEnd* ends, size_t count) {
+    MiniSeedInfo info;
+    if (count == 0 || miniseed_decode(record->data, record->length, &info) < 0) return 0;
+    ReplayEnd key = { miniseed_nslc_hash(&info), 0 };
+    const ReplayEnd* end = bsearch(&key, ends, count, sizeof(ReplayEnd), compare_replay_end);
+    return end && miniseed_end_time(&info) <= end->end_time;
+}
+
+// 按各段当前记录的序号维护小顶堆
+static void sift_down(ReplayRun* heap, size_t count, size_t i) {
+    while (1) {
+        size_t smallest = i;
+        size_t left = 2 * i + 1, right = left + 1;
+        if (left < count && heap[left].items->sequence < heap[smallest].items->sequence) smallest = left;
+        if (right < count && heap[right].items->sequence < heap[smallest].items->sequence) smallest = right;
+        if (smallest == i) return;
+        ReplayRun tmp = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+// 各通道的最近数据环本身按广播顺序排列，多路归并成一个序列，runs在合并中被消耗
+static void merge_runs(ReplayRun* runs, size_t count, SharedRecord** out) {
+    for (size_t i = count / 2; i-- > 0; ) sift_down(runs, count, i);
+    while (count > 0) {
+        *out++ = runs[0].items->record;
+        runs[0].items++;
+        if (--runs[0].count == 0) runs[0] = runs[--count];
+        sift_down(runs, count, 0);
+    }
+}
+
+// 回放最近数据环中结束时间晚于since、匹配订阅、并且在客户端连接之前广播的记录，由事件循环线程调用。
+// 连接之后的记录都已实时排队，与广播在同一把锁下进行，因此没有遗漏也没有重复；
+// 之后环中新加入的记录序号都不小于connect_sequence，锁外处理期间符合条件的记录只会减少。
+// 持锁时只统计数量、取得记录引用和最后拼接队列，分配内存和多路归并都在锁外进行。
+// 回放在事件循环线程中进行，期间不向该客户端发送；锁外期间广播的实时记录排在队列中，
+// 拼接时回放的记录连同回复一起插在它们之前（只发送了一部分的队首记录之后，
+// 该记录只由事件循环线程发送，锁外期间不变），并跳过同一通道中结束时间不晚于回放的最后一条记录的实时记录，
+// 客户端收到的每个通道都按时间递增、不重复。队列临时扩大以放下回放的记录；
+// 队列中只是共享记录的引用，不复制数据。返回回放的记录数，失败时返回-1
+static int replay_history(TCPServer* server, ClientConnection* client, int64_t since, SharedRecord* reply) {
+    size_t total = 0, route_total = 0;
+    pthread_mutex_lock(&server->mutex);
+    if (server->history_window == 0 || client->replayed || client->closing) {
+        pthread_mutex_unlock(&server->mutex);
+        return -1;
+    }
+    for (size_t i = 0; i < SERVER_ROUTE_BUCKETS; i++) {
+        for (RouteEntry* entry = server->routes[i]; entry; entry = entry->next) {
+            if (entry->history_count == 0 || !route_subscribed(client, entry)) continue;
+            total += entry->history_count;
+            route_total++;
+        }
+    }
+    uint64_t size = client->mask + 1;
+    pthread_mutex_unlock(&server->mutex);
+    
+    uint64_t needed = size + total + 1 + client->capacity;
+    while (size < needed) size <<= 1;
+    HistoryRecord* items = (HistoryRecord*)malloc((total + 1) * sizeof(HistoryRecord));
+    ReplayRun* runs = (ReplayRun*)malloc((route_total + 1) * sizeof(ReplayRun));
+    ReplayEnd* ends = (ReplayEnd*)malloc((route_total + 1) * sizeof(ReplayEnd));
+    SharedRecord** queue = size <= UINT32_MAX ? (SharedRecord**)malloc(size * sizeof(SharedRecord*)) : NULL;
+    if (!items || !runs || !ends || !queue) {
+        free(items);
+        free(runs);
+        free(ends);
+        free(queue);
+        return -1;
+    }
+    
+    // 取得符合条件的记录的引用
+    size_t n = 0, run_count = 0;
+    pthread_mutex_lock(&server->mutex);
+    for (size_t i = 0; i < SERVER_ROUTE_BUCKETS; i++) {
+        for (RouteEntry* entry = server->routes[i]; entry; entry = entry->next) {
+            if (entry->history_count == 0 || !route_subscribed(client, entry)) continue;
+            size_t first = n;
+            int64_t last_end = INT64_MIN;
+            for (uint32_t j = 0; j < entry->history_count && n < total; j++) {
+                const HistoryRecord* item = &entry->history[(entry->history_head + j) & entry->history_mask];
+                if (item->sequence >= client->connect_sequence) break;
+                if (item->end_time <= since) continue;
+                record_ref(item->record);
+                items[n++] = *item;
+                if (item->end_time > last_end) last_end = item->end_time;
+            }
+            if (n > first && run_count < route_total) {
+                runs[run_count].items = &items[first];
+                runs[run_count].count = n - first;
+                ends[run_count].hash = entry->hash;
+                ends[run_count].end_time = last_end;
+                run_count++;
+            }
+        }
+    }
+    pthread_mutex_unlock(&server->mutex);
+    
+    uint32_t keep = client->sent > 0 ? 1 : 0;
+    merge_runs(runs, run_count, &queue[keep + 1]);
+    qsort(ends, run_count, sizeof(ReplayEnd), compare_replay_end);
+    free(runs);
+    free(items);
+    
+    // 拼接：正在发送的队首记录、回复、回放的记录、已排队的实时记录（跳过与回放重叠的）
+    pthread_mutex_lock(&server->mutex);
+    if (client->closing) {
+        pthread_mutex_unlock(&server->mutex);
+        record_unref_many(&queue[keep + 1], (int)n);
+        free(ends);
+        free(queue);
+        return -1;
+    }
+    for (uint32_t i = 0; i < keep; i++) queue[i] = client->queue[(client->head + i) & client->mask];
+    record_ref(reply);
+    queue[keep] = reply;
+    uint32_t k = keep + 1 + (uint32_t)n;
+    for (uint32_t i = keep; i < client->count; i++) {
+        SharedRecord* record = client->queue[(client->head + i) & client->mask];
+        if (replay_overlaps(record, ends, run_count)) {
+            record_unref(record);
+            server->replay_overlaps++;
+            continue;
+        }
+        queue[k++] = record;
+    }
+    
+    free(client->queue);
+    client->queue = queue;
+    client->mask = (uint32_t)(size - 1);
+    client->head = 0;
+    client->count = k;
+    client->replayed = 1;
+    server->replays++;
+    server->replayed += n;
+    int wake = schedule_client(server, client);
+    pthread_mutex_unlock(&server->mutex);
+    if (wake) wake_loop(server);
+    free(ends);
+    return (int)n;
+}
+
+// 回放的记录发送完后把队列缩回正常容量，需持有锁且没有正在发送的记录
+static void shrink_queue(ClientConnection* client) {
+    SharedRecord** queue = (SharedRecord**)malloc(client->capacity * sizeof(SharedRecord*));
+    if (!queue) return;
+    for (uint32_t i = 0; i < client->count; i++) queue[i] = client->queue[(client->head + i) & client->mask];
+    free(client->queue);
+    client->queue = queue;
+    client->mask = client->capacity - 1;
+    client->head = 0;
+}
+
+// 加入客户端表并注册到epoll
+static ClientConnection* add_client(TCPServer* server, int fd, const struct sockaddr_in* addr) {
+    ClientConnection* client = (ClientConnection*)calloc(1, sizeof(ClientConnection));
+    if (!client) return NULL;
+    client->sockfd = fd;
+    client->addr = *addr;
+    client->server = server;
+    
+    pthread_mutex_lock(&server->mutex);
+    client->mask = server->queue_capacity - 1;
+    client->capacity = server->queue_capacity;
+    client->connect_sequence = server->sequence;
+    client->queue = (SharedRecord**)malloc(server->queue_capacity * sizeof(SharedRecord*));
+    if (!client->queue) {
+        pthread_mutex_unlock(&server->mutex);
+        free(client);
+        return NULL;
+    }
+    if (server->client_count == server->client_capacity) {
+        int capacity = server->client_capacity ? server->client_capacity * 2 : SERVER_INITIAL_CLIENTS;
+        ClientConnection** clients = (ClientConnection**)realloc(server->clients, capacity * sizeof(ClientConnection*));
+        if (clients) server->clients = clients;
+        ClientConnection** ready = (ClientConnection**)realloc(server->ready, capacity * sizeof(ClientConnection*));
+        if (ready) server->ready = ready;
+        ClientConnection** work = (ClientConnection**)realloc(server->ready_work, capacity * sizeof(ClientConnection*));
+        if (work) server->ready_work = work;
+        if (!clients || !ready || !work) {
+            pthread_mutex_unlock(&server->mutex);
+            free(client->queue);
+            free(client);
+            return NULL;
+        }
+        server->client_capacity = capacity;
+    }
+    client->index = server->client_count;
+    server->clients[server->client_count++] = client;
+    route_update_client(server, client, 1);
+    // 启用最近数据环时先不发送实时数据，客户端随后发送的SINCE回放能排在所有实时记录之前
+    if (server->history_window > 0) {
+        client->hold_until = monotonic_ms() + SERVER_REPLAY_HOLD_MS;
+        server->held_clients++;
+    }
+    pthread_mutex_unlock(&server->mutex);
+    
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.ptr = client;
+    if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        seedlink_log(LOG_ERROR, "epoll_ctl失败: %s", strerror(errno));
+    }
+    return client;
+}
+
+// 从客户端表中移除并关闭连接；先移出表再关闭，广播不会用到已关闭的描述符。
+// 同一轮epoll事件中可能还有该客户端的事件，结构体在本轮处理完后再释放
+static void remove_client(TCPServer* server, ClientConnection* client) {
     char client_ip[INET_ADDRSTRLEN];
     inet_ntop(AF_INET, &client->addr.sin_addr, client_ip, sizeof(client_ip));
-    int client_port = ntohs(client->addr.sin_port);
-    
-    // 设置socket选项，只保留基本的keepalive
-    int keepalive = 1;
-    setsockopt(client->sockfd, SOL_SOCKET, SO_KEEPALIVE, &keepalive, sizeof(keepalive));
-    
-    // 设置接收超时
-    struct timeval tv;
-    tv.tv_sec = 60;
-    tv.tv_usec = 0;
-    setsockopt(client->sockfd, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof(tv));
-    
-    // 发送欢迎消息
-    const char* welcome = "Welcome to MiniSEED Server\n";
-    send(client->sockfd, welcome, strlen(welcome), 0);
-    
-    // 等待客户端命令
-    while (client->is_active) {
-        char buffer[1024];
-        int n = recv(client->sockfd, buffer, sizeof(buffer)-1, 0);
+    
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, client->sockfd, NULL);
+    pthread_mutex_lock(&server->mutex);
+    ClientConnection* last = server->clients[--server->client_count];
+    server->clients[client->index] = last;
+    last->index = client->index;
+    route_update_client(server, client, 0);
+    if (client->hold_until) server->held_clients--;
+    if (client->scheduled) {
+        for (int i = 0; i < server->ready_count; i++) {
+            if (server->ready[i] == client) {
+                server->ready[i] = server->ready[--server->ready_count];
+                break;
+            }
+        }
+    }
+    int count = server->client_count;
+    uint32_t queued = client->count;
+    uint32_t head = client->head;
+    client->count = 0;
+    pthread_mutex_unlock(&server->mutex);
+    
+    for (uint32_t i = 0; i < queued; i++) {
+        record_unref(client->queue[(head + i) & client->mask]);
+    }
+    
+    if (client->dropped > 0) {
+        seedlink_log(LOG_INFO, "客户端 %s:%d 已断开 (当前连接数: %d, 因发送队列满丢弃%llu条记录)",
+                     client_ip, ntohs(client->addr.sin_port), count, (unsigned long long)client->dropped);
+    } else {
+        seedlink_log(LOG_INFO, "客户端 %s:%d 已断开 (当前连接数: %d)",
+                     client_ip, ntohs(client->addr.sin_port), count);
+    }
+    close(client->sockfd);
+    client->closed = 1;
+    client->dead_next = server->dead;
+    server->dead = client;
+}
+
+// 释放已断开的客户端
+static void free_dead_clients(TCPServer* server) {
+    while (server->dead) {
+        ClientConnection* client = server->dead;
+        server->dead = client->dead_next;
+        free(client->queue);
+        free(client);
+    }
+}
+
+// 非阻塞地发送队列中的记录，直到队列为空或socket写满；
+// 每次用一个sendmsg发送队首最多SERVER_SEND_BATCH条记录，写满时等待边沿触发的EPOLLOUT再继续。
+// 系统调用都在锁外进行，发送期间这些记录计入inflight，广播不会丢弃它们
+static void flush_client(TCPServer* server, ClientConnection* client) {
+    struct iovec iov[SERVER_SEND_BATCH];
+    SharedRecord* done[SERVER_SEND_BATCH];
+    
+    for (;;) {
+        pthread_mutex_lock(&server->mutex);
+        if (client->closing || client->count == 0 || client->hold_until) {
+            int closing = client->closing;
+            pthread_mutex_unlock(&server->mutex);
+            if (closing) {
+                char client_ip[INET_ADDRSTRLEN];
+                inet_ntop(AF_INET, &client->addr.sin_addr, client_ip, sizeof(client_ip));
+                seedlink_log(LOG_WARN, "客户端 %s:%d 接收过慢，发送队列已满，断开连接",
+                             client_ip, ntohs(client->addr.sin_port));
+                remove_client(server, client);
+            }
+            return;
+        }
+        int iov_count = client->count < SERVER_SEND_BATCH ? (int)client->count : SERVER_SEND_BATCH;
+        size_t total = 0;
+        for (int i = 0; i < iov_count; i++) {
+            SharedRecord* record = client->queue[(client->head + i) & client->mask];
+            size_t skip = i == 0 ? client->sent : 0;
+            iov[i].iov_base = record->data + skip;
+            iov[i].iov_len = record->length - skip;
+            total += iov[i].iov_len;
+        }
+        client->inflight = iov_count;
+        pthread_mutex_unlock(&server->mutex);
+        
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iov_count;
+        ssize_t n = sendmsg(client->sockfd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+        
+        // 按发送的字节数依次取出已发完的记录，最后一条可能只发送了一部分
+        pthread_mutex_lock(&server->mutex);
+        client->inflight = 0;
+        int done_count = 0;
+        size_t remaining = n > 0 ? (size_t)n : 0;
+        while (remaining > 0) {
+            SharedRecord* record = client->queue[client->head & client->mask];
+            size_t left = record->length - client->sent;
+            if (remaining < left) {
+                client->sent += remaining;
+                break;
+            }
+            remaining -= left;
+            client->sent = 0;
+            client->head++;
+            client->count--;
+            done[done_count++] = record;
+        }
+        if (client->paused && client->count <= client->mask / 2) client->paused = 0;
+        if (client->mask + 1 > client->capacity && client->count <= client->capacity / 2) shrink_queue(client);
+        pthread_mutex_unlock(&server->mutex);
+        record_unref_many(done, done_count);
         
         if (n < 0) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                // 接收超时，检查连接状态
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+            char client_ip[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &client->addr.sin_addr, client_ip, sizeof(client_ip));
+            seedlink_log(LOG_INFO, "客户端连接错误: %s:%d (%s)",
+                         client_ip, ntohs(client->addr.sin_port), strerror(errno));
+            remove_client(server, client);
+            return;
+        }
+        if ((size_t)n < total) return;
+    }
+}
+
+// 恢复向暂停的新连接发送，由事件循环线程调用
+static void release_client(TCPServer* server, ClientConnection* client) {
+    if (!client->hold_until) return;
+    pthread_mutex_lock(&server->mutex);
+    client->hold_until = 0;
+    server->held_clients--;
+    pthread_mutex_unlock(&server->mutex);
+    flush_client(server, client);
+}
+
+// 恢复等待超时的新连接，返回到下一个客户端超时还有多少毫秒，没有等待的客户端时返回-1。
+// 从后往前遍历，发送失败移除客户端时用最后一个填补的空位已经处理过
+static int release_held_clients(TCPServer* server) {
+    int64_t now = monotonic_ms(), next = -1;
+    for (int i = server->client_count - 1; i >= 0; i--) {
+        ClientConnection* client = server->clients[i];
+        if (!client->hold_until) continue;
+        if (client->hold_until <= now) {
+            release_client(server, client);
+        } else if (next < 0 || client->hold_until - now < next) {
+            next = client->hold_until - now;
+        }
+    }
+    return (int)next;
+}
+
+// 处理待发送列表：取走列表后在锁外逐个发送
+static void flush_ready(TCPServer* server) {
+    uint64_t value;
+    if (read(server->wake_fd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+        seedlink_log(LOG_ERROR, "读取eventfd失败: %s", strerror(errno));
+    }
+    
+    pthread_mutex_lock(&server->mutex);
+    ClientConnection** work = server->ready;
+    int count = server->ready_count;
+    server->ready = server->ready_work;
+    server->ready_work = work;
+    server->ready_count = 0;
+    server->wake_pending = 0;
+    for (int i = 0; i < count; i++) {
+        work[i]->scheduled = 0;
+    }
+    pthread_mutex_unlock(&server->mutex);
+    
+    for (int i = 0; i < count && server->running; i++) {
+        if (!work[i]->closed) flush_client(server, work[i]);
+    }
+}
+
+// 接受所有等待中的连接
+// 文件描述符用完时用预留的描述符接受并立即关闭，否则监听socket一直可读，事件循环会空转
+static void accept_clients(TCPServer* server) {
+    for (;;) {
+        struct sockaddr_in client_addr;
+        socklen_t addrlen = sizeof(client_addr);
+        int client_fd = accept4(server->server_fd, (struct sockaddr*)&client_addr, &addrlen,
+                                SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if ((errno == EMFILE || errno == ENFILE) && server->spare_fd >= 0) {
+                seedlink_log(LOG_WARN, "文件描述符已用完，拒绝新的客户端连接");
+                close(server->spare_fd);
+                int fd = accept(server->server_fd, NULL, NULL);
+                if (fd >= 0) close(fd);
+                server->spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
                 continue;
             }
-            seedlink_log(LOG_INFO, "客户端连接错误: %s:%d (%s)", 
-                        client_ip, client_port, strerror(errno));
-            break;
-        } else if (n == 0) {
-            seedlink_log(LOG_INFO, "客户端正常断开连接: %s:%d", client_ip, client_port);
-            break;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                seedlink_log(LOG_ERROR, "接受连接失败: %s", strerror(errno));
+            }
+            return;
+        }
+        
+        // 获取客户端IP和端口
+        char client_ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, sizeof(client_ip));
+        int client_port = ntohs(client_addr.sin_port);
+        
+        // 设置socket选项，只保留基本的keepalive
+        int keepalive = 1;
+        setsockopt(client_fd, SOL_SOCKET, SO_KEEPALIVE, &keepalive, sizeof(keepalive));
+        
+        // 发送欢迎消息，新连接的发送缓冲区为空，不会写满
+        const char* welcome = "Welcome to MiniSEED Server\n";
+        send(client_fd, welcome, strlen(welcome), MSG_NOSIGNAL | MSG_DONTWAIT);
+        
+        if (!add_client(server, client_fd, &client_addr)) {
+            seedlink_log(LOG_ERROR, "拒绝客户端连接 %s:%d - 内存不足", client_ip, client_port);
+            close(client_fd);
+            continue;
         }
+        seedlink_log(LOG_INFO, "新客户端连接: %s:%d (总连接数: %d)",
+                     client_ip, client_port, server->client_count);
     }
+}
+
+// 把回复放入客户端的发送队列，与数据记录按顺序发送
+static void send_reply(TCPServer* server, ClientConnection* client, const char* text) {
+    SharedRecord* record = record_pool_alloc(server->pool, (const unsigned char*)text, strlen(text));
+    if (!record) return;
+    pthread_mutex_lock(&server->mutex);
+    int wake = enqueue_record(server, client, record);
+    pthread_mutex_unlock(&server->mutex);
+    if (wake) wake_loop(server);
+    record_unref(record);
+}
+
+// SINCE命令：回复OK，随后回放最近数据环中的记录，每个连接只能执行一次
+static int handle_since(TCPServer* server, ClientConnection* client, int64_t since) {
+    SharedRecord* reply = record_pool_alloc(server->pool, (const unsigned char*)"OK\r\n", 4);
+    if (!reply) return -1;
     
-    // 更新客户端状态
-    pthread_mutex_lock(&client->server->mutex);
-    client->is_active = 0;
-    client->server->client_count--;
-    seedlink_log(LOG_INFO, "客户端 %s:%d 已断开 (当前连接数: %d)", 
-                 client_ip, client_port, client->server->client_count);
-    pthread_mutex_unlock(&client->server->mutex);
+    int n = replay_history(server, client, since, reply);
+    record_unref(reply);
+    release_client(server, client);
+    if (n < 0) return -1;
     
-    close(client->sockfd);
-    return NULL;
+    char client_ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &client->addr.sin_addr, client_ip, sizeof(client_ip));
+    seedlink_log(LOG_INFO, "客户端 %s:%d 回放最近数据 %d 条记录", client_ip, ntohs(client->addr.sin_port), n);
+    return 0;
+}
+
+// 处理客户端的一行命令：
+// SUBSCRIBE NET.STA.LOC.CHA [...]  增加订阅，之后只接收匹配的通道
+// UNSUBSCRIBE                      取消所有订阅，恢复接收所有记录
+// SINCE [时间]                     回放连接之前、结束时间晚于该时间的最近数据，省略时间时回放全部
+static void handle_command(TCPServer* server, ClientConnection* client, char* line) {
+    char* save = NULL;
+    char* command = strtok_r(line, " \t", &save);
+    if (!command) return;
+    
+    int ok = 0;
+    if (strcasecmp(command, "SUBSCRIBE") == 0) {
+        NslcPattern patterns[SERVER_MAX_PATTERNS];
+        int count = 0;
+        ok = 1;
+        for (char* tok = strtok_r(NULL, " \t", &save); tok; tok = strtok_r(NULL, " \t", &save)) {
+            if (count == SERVER_MAX_PATTERNS || miniseed_parse_pattern(tok, &patterns[count]) < 0) {
+                ok = 0;
+                break;
+            }
+            count++;
+        }
+        
+        pthread_mutex_lock(&server->mutex);
+        if (ok && count > 0 && client->pattern_count + count <= SERVER_MAX_PATTERNS) {
+            memcpy(&client->patterns[client->pattern_count], patterns, count * sizeof(NslcPattern));
+            client->pattern_count += count;
+            route_update_client(server, client, 1);
+        } else {
+            ok = 0;
+        }
+        pthread_mutex_unlock(&server->mutex);
+    } else if (strcasecmp(command, "UNSUBSCRIBE") == 0) {
+        pthread_mutex_lock(&server->mutex);
+        client->pattern_count = 0;
+        route_update_client(server, client, 1);
+        pthread_mutex_unlock(&server->mutex);
+        ok = 1;
+    } else if (strcasecmp(command, "SINCE") == 0) {
+        char* text = strtok_r(NULL, " \t", &save);
+        int64_t since = INT64_MIN;
+        if ((!text || miniseed_parse_time(text, &since) == 0) && handle_since(server, client, since) == 0) return;
+    }
+    send_reply(server, client, ok ? "OK\r\n" : "ERROR\r\n");
+}
+
+// 按行切分客户端发来的数据，过长的行回复ERROR并丢弃
+static void handle_input(TCPServer* server, ClientConnection* client, const char* data, size_t length) {
+    for (size_t i = 0; i < length && !client->closed; i++) {
+        if (data[i] != '\n') {
+            if (client->line_length < SERVER_LINE_SIZE - 1) client->line[client->line_length++] = data[i];
+            else client->line_overflow = 1;
+            continue;
+        }
+        
+        if (client->line_overflow) {
+            send_reply(server, client, "ERROR\r\n");
+        } else {
+            if (client->line_length > 0 && client->line[client->line_length - 1] == '\r') client->line_length--;
+            client->line[client->line_length] = '\0';
+            handle_command(server, client, client->line);
+        }
+        client->line_length = 0;
+        client->line_overflow = 0;
+    }
+}
+
+// 客户端事件：可写时继续发送；可读时处理命令，连接关闭或出错时移除
+// 边沿触发，读取直到EAGAIN
+static void handle_client(TCPServer* server, ClientConnection* client, uint32_t events) {
+    if (events & EPOLLOUT) {
+        flush_client(server, client);
+        if (client->closed) return;
+    }
+    if (!(events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))) return;
+    
+    char buffer[1024];
+    for (;;) {
+        ssize_t n = recv(client->sockfd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (n > 0) {
+            handle_input(server, client, buffer, n);
+            if (client->closed) return;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && !(events & (EPOLLHUP | EPOLLERR))) return;
+        
+        if (n < 0) {
+            char client_ip[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &client->addr.sin_addr, client_ip, sizeof(client_ip));
+            seedlink_log(LOG_INFO, "客户端连接错误: %s:%d (%s)",
+                         client_ip, ntohs(client->addr.sin_port), strerror(errno));
+        }
+        remove_client(server, client);
+        return;
+    }
 }
 
 // 创建服务器
@@ -79,32 +866,46 @@ TCPServer* server_create(int port) {
     memset(server, 0, sizeof(TCPServer));
     server->server_fd = -1;
     server->client_count = 0;
+    server->policy = SERVER_POLICY_DROP_OLDEST;
+    server->queue_capacity = SERVER_CLIENT_QUEUE;
     
     // 初始化地址
     server->addr.sin_family = AF_INET;
     server->addr.sin_addr.s_addr = htonl(INADDR_ANY);
     server->addr.sin_port = htons(port);
     
-    // 初始化互斥锁
-    if (pthread_mutex_init(&server->mutex, NULL) != 0) {
+    // 初始化互斥锁和记录池
+    server->pool = record_pool_create();
+    server->routes = (RouteEntry**)calloc(SERVER_ROUTE_BUCKETS, sizeof(RouteEntry*));
+    if (!server->pool || !server->routes || pthread_mutex_init(&server->mutex, NULL) != 0) {
+        record_pool_destroy(server->pool);
+        free(server->routes);
         free(server);
         return NULL;
     }
     
-    // 初始化客户端数组
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        server->clients[i].sockfd = -1;
-        server->clients[i].is_active = 0;
-        server->clients[i].server = server;  // 设置指向服务器的指针
+    server->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    server->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    server->spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (server->epoll_fd < 0 || server->wake_fd < 0) {
+        seedlink_log(LOG_ERROR, "创建epoll失败: %s", strerror(errno));
+        server_destroy(server);
+        return NULL;
     }
     
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = &server->wake_fd;
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->wake_fd, &ev);
+    
     return server;
 }
 
-// 启动服务器
+// 启动服务器：运行事件循环直到server_stop
 int server_start(TCPServer* server) {
     // 创建socket
-    server->server_fd = socket(AF_INET, SOCK_STREAM, 0);
+    server->server_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (server->server_fd < 0) {
         seedlink_log(LOG_ERROR, "创建socket失败: %s", strerror(errno));
         return -1;
@@ -123,96 +924,158 @@ int server_start(TCPServer* server) {
         return -1;
     }
     
-    // 开始监听
-    if (listen(server->server_fd, 3) < 0) {
+    // 开始监听，等待队列使用系统允许的最大值
+    if (listen(server->server_fd, SOMAXCONN) < 0) {
         seedlink_log(LOG_ERROR, "监听失败: %s", strerror(errno));
         return -1;
     }
     
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->server_fd, &ev) < 0) {
+        seedlink_log(LOG_ERROR, "epoll_ctl失败: %s", strerror(errno));
+        return -1;
+    }
+    
     seedlink_log(LOG_INFO, "服务器正在监听 0.0.0.0:%d", ntohs(server->addr.sin_port));
     
-    // 接受客户端连接
-    while (1) {
-        struct sockaddr_in client_addr;
-        socklen_t addrlen = sizeof(client_addr);
-        
-        int client_fd = accept(server->server_fd, (struct sockaddr*)&client_addr, &addrlen);
-        if (client_fd < 0) {
-            seedlink_log(LOG_ERROR, "接受连接失败: %s", strerror(errno));
-            continue;
+    // 事件循环：接受连接、发送数据、检测客户端断开
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    server->running = 1;
+    while (server->running) {
+        int timeout = server->held_clients > 0 ? release_held_clients(server) : -1;
+        int n = epoll_wait(server->epoll_fd, events, SERVER_MAX_EVENTS, timeout);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            seedlink_log(LOG_ERROR, "epoll_wait失败: %s", strerror(errno));
+            break;
         }
         
-        // 获取客户端IP和端口
-        char client_ip[INET_ADDRSTRLEN];
-        inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, sizeof(client_ip));
-        int client_port = ntohs(client_addr.sin_port);
-        
-        // 查找空闲的客户端槽位
-        pthread_mutex_lock(&server->mutex);
-        int slot = -1;
-        for (int i = 0; i < MAX_CLIENTS; i++) {
-            if (!server->clients[i].is_active) {
-                slot = i;
-                break;
+        for (int i = 0; i < n && server->running; i++) {
+            void* ptr = events[i].data.ptr;
+            if (ptr == NULL) {
+                accept_clients(server);
+            } else if (ptr == &server->wake_fd) {
+                flush_ready(server);
+            } else if (!((ClientConnection*)ptr)->closed) {
+                handle_client(server, (ClientConnection*)ptr, events[i].events);
             }
         }
-        
-        if (slot >= 0) {
-            // 初始化客户端连接
-            server->clients[slot].sockfd = client_fd;
-            server->clients[slot].addr = client_addr;
-            server->clients[slot].is_active = 1;
-            server->client_count++;
-            
-            // 创建客户端处理线程
-            pthread_create(&server->clients[slot].thread, NULL, client_handler, &server->clients[slot]);
-            
-            seedlink_log(LOG_INFO, "新客户端连接: %s:%d (总连接数: %d)", 
-                        client_ip, client_port, server->client_count);
-        } else {
-            // 达到最大客户端数量
-            close(client_fd);
-            seedlink_log(LOG_WARN, "拒绝客户端连接 %s:%d - 达到最大连接数 %d", 
-                        client_ip, client_port, MAX_CLIENTS);
-        }
-        pthread_mutex_unlock(&server->mutex);
+        free_dead_clients(server);
     }
     
+    // 关闭所有客户端连接
+    while (server->client_count > 0) {
+        remove_client(server, server->clients[server->client_count - 1]);
+    }
+    free_dead_clients(server);
+    seedlink_log(LOG_INFO, "转发记录池: 分配%llu次, 最多同时使用%llu个缓冲区, %zu块",
+                 (unsigned long long)server->pool->allocs,
+                 (unsigned long long)server->pool->peak_in_use, server->pool->slab_count);
+    seedlink_log(LOG_INFO, "转发路由: 缓存%zu个通道, 完整计算订阅者%llu次",
+                 server->route_count, (unsigned long long)server->route_rebuilds);
+    if (server->replays > 0) {
+        seedlink_log(LOG_INFO, "最近数据回放: %llu次, 共%llu条记录, 跳过与回放重叠的实时记录%llu条",
+                     (unsigned long long)server->replays, (unsigned long long)server->replayed,
+                     (unsigned long long)server->replay_overlaps);
+    }
+    if (server->dropped > 0 || server->slow_disconnects > 0) {
+        seedlink_log(LOG_INFO, "转发服务器: 客户端发送队列满丢弃%llu条记录, 断开%llu个过慢的客户端",
+                     (unsigned long long)server->dropped, (unsigned long long)server->slow_disconnects);
+    }
     return 0;
 }
 
-// 广播数据给所有客户端
-int server_broadcast_data(TCPServer* server, const unsigned char* data, size_t size) {
-    pthread_mutex_lock(&server->mutex);
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (server->clients[i].is_active) {
-            send(server->clients[i].sockfd, data, size, 0);
+// 广播一批记录给订阅了对应通道的客户端：每条记录复制到记录池的共享缓冲区一次，
+// 整批只加一次锁，持锁期间只向各客户端队列和通道的最近数据环追加指针，最多唤醒事件循环一次
+int server_broadcast_records(TCPServer* server, const QueueRecord* records, int count) {
+    if ((server->client_count == 0 && server->history_window == 0) || count <= 0) return 0;
+    
+    SharedRecord* shared[SERVER_SEND_BATCH];
+    const MiniSeedInfo* infos[SERVER_SEND_BATCH];
+    int failed = 0;
+    while (count > 0) {
+        // 记录池分配失败（记录过长或内存不足）时只跳过这一条，其余记录照常转发
+        int n = 0, used = 0;
+        for (; used < count && n < SERVER_SEND_BATCH; used++) {
+            shared[n] = record_pool_alloc(server->pool, records[used].data, records[used].length);
+            if (!shared[n]) {
+                failed++;
+                continue;
+            }
+            infos[n++] = records[used].info;
+        }
+        records += used;
+        count -= used;
+        if (n == 0) continue;
+        
+        // 按通道查找订阅者，只向匹配的客户端追加；没有通道信息的记录发给所有客户端
+        int wake = 0;
+        pthread_mutex_lock(&server->mutex);
+        for (int j = 0; j < n; j++) {
+            const MiniSeedInfo* info = infos[j];
+            uint64_t sequence = server->sequence++;
+            RouteEntry* route = info ? route_lookup(server, info) : NULL;
+            if (route && server->history_window > 0) history_append(server, route, shared[j], info, sequence);
+            if (route) {
+                for (int k = 0; k < route->count; k++) {
+                    wake |= enqueue_record(server, route->subscribers[k], shared[j]);
+                }
+                continue;
+            }
+            for (int i = 0; i < server->client_count; i++) {
+                if (!info || client_subscribes(server->clients[i], info->network, info->station,
+                                               info->location, info->channel)) {
+                    wake |= enqueue_record(server, server->clients[i], shared[j]);
+                }
+            }
         }
+        pthread_mutex_unlock(&server->mutex);
+        
+        if (wake) wake_loop(server);
+        record_unref_many(shared, n);
     }
-    pthread_mutex_unlock(&server->mutex);
-    return 0;
+    return failed > 0 ? -1 : 0;
+}
+
+// 广播一条数据给所有客户端
+int server_broadcast_data(TCPServer* server, const unsigned char* data, size_t size) {
+    QueueRecord record = { NULL, data, size };
+    return server_broadcast_records(server, &record, 1);
 }
 
-// 停止服务器
+// 停止服务器：通过eventfd唤醒事件循环，由事件循环关闭所有客户端连接
 void server_stop(TCPServer* server) {
-    // 关闭所有客户端连接
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (server->clients[i].is_active) {
-            close(server->clients[i].sockfd);
-            server->clients[i].is_active = 0;
-            pthread_join(server->clients[i].thread, NULL);
-        }
-    }
-    
-    // 关闭服务器socket
-    close(server->server_fd);
+    server->running = 0;
+    if (server->wake_fd >= 0) wake_loop(server);
 }
 
-// 销毁服务器
+// 销毁服务器，应在事件循环线程退出之后调用
 void server_destroy(TCPServer* server) {
     if (server) {
         server_stop(server);
+        for (int i = 0; i < server->client_count; i++) {
+            ClientConnection* client = server->clients[i];
+            for (uint32_t j = 0; j < client->count; j++) {
+                record_unref(client->queue[(client->head + j) & client->mask]);
+            }
+            close(client->sockfd);
+            free(client->queue);
+            free(client);
+        }
+        clear_routes(server);
+        free(server->routes);
+        record_pool_destroy(server->pool);
+        free(server->clients);
+        free(server->ready);
+        free(server->ready_work);
+        if (server->server_fd >= 0) close(server->server_fd);
+        if (server->epoll_fd >= 0) close(server->epoll_fd);
+        if (server->wake_fd >= 0) close(server->wake_fd);
+        if (server->spare_fd >= 0) close(server->spare_fd);
         pthread_mutex_destroy(&server->mutex);
         free(server);
     }
-} 
\ No newline at end of file
+}
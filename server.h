@@ -11,38 +11,149 @@
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <errno.h>
+#include <stdatomic.h>
 #include "seedlink.h"
+#include "queue.h"
+#include "record_pool.h"
 
-#define MAX_CLIENTS 10
 #define SERVER_PORT 8000
+#define SERVER_MAX_EVENTS 64
+#define SERVER_INITIAL_CLIENTS 16     // 客户端表的初始容量，满时加倍
+#define SERVER_CLIENT_QUEUE 256       // 每个客户端默认最多排队的记录数
+#define SERVER_SEND_BATCH 64          // 一次sendmsg最多发送的记录数
+#define SERVER_MAX_PATTERNS 16        // 每个客户端最多订阅的通道模式数
+#define SERVER_LINE_SIZE 256          // 客户端命令的最大长度
+#define SERVER_ROUTE_BUCKETS 1024     // 通道路由表的桶数
+#define SERVER_ROUTE_MAX 65536        // 路由表最多缓存的通道数，超出时清空重建
+#define SERVER_HISTORY_RECORDS 4096   // 每个通道最近数据环最多保留的记录数
+#define SERVER_REPLAY_HOLD_MS 500     // 启用最近数据环时，新连接最多等这么久的SINCE再开始发送实时数据
+
+// 客户端发送队列满时的策略
+typedef enum {
+    SERVER_POLICY_DROP_OLDEST,  // 丢弃最早的未发送记录
+    SERVER_POLICY_DISCONNECT,   // 断开该客户端
+    SERVER_POLICY_PAUSE         // 暂停向该客户端排队，队列降到一半以下后恢复
+} ServerPolicy;
 
 // 前向声明
 struct TCPServer;
 
-// 先定义 ClientConnection
-typedef struct {
+// 一个下游客户端连接
+// 发送队列是共享记录指针的环形缓冲区，由mutex保护：广播只在队列尾追加指针，
+// 事件循环线程在锁外用一次sendmsg非阻塞地发送队首的多条记录，这些记录在发送完成之前不会被丢弃
+typedef struct ClientConnection {
     int sockfd;
     struct sockaddr_in addr;
-    pthread_t thread;
-    int is_active;
-    struct TCPServer* server;  // 使用前向声明的类型
+    int index;                  // 在客户端表中的位置
+    struct TCPServer* server;
+    
+    SharedRecord** queue;
+    uint32_t mask;
+    uint32_t head;
+    uint32_t count;
+    size_t sent;                // 队首记录已发送的字节数
+    uint32_t inflight;          // 队首正在发送的记录数，不能被丢弃
+    uint64_t dropped;           // 因队列满而丢弃的记录数
+    int paused;
+    int closing;                // 需要由事件循环断开
+    int scheduled;              // 已在待发送列表中
+    int closed;                 // 已断开，本轮事件处理完后释放
+    struct ClientConnection* dead_next;
+    uint32_t capacity;          // 正常的队列容量，回放时队列临时扩大，发送完后缩回
+    uint64_t connect_sequence;  // 连接时的记录序号，之后的记录实时发送，不再回放
+    int replayed;               // 已执行过SINCE
+    int64_t hold_until;         // 启用最近数据环时新连接暂不发送，直到回放已排队或到达该时刻（毫秒），0为不暂停
+    
+    // 订阅：没有订阅时接收所有记录
+    NslcPattern patterns[SERVER_MAX_PATTERNS];
+    int pattern_count;
+    char line[SERVER_LINE_SIZE];    // 未读完的命令行
+    size_t line_length;
+    int line_overflow;              // 当前行过长，丢弃到行尾
 } ClientConnection;
 
-// 再定义 TCPServer
+// 最近数据环中的一条记录
+typedef struct {
+    SharedRecord* record;
+    int64_t end_time;
+    uint64_t sequence;          // 广播顺序，回放时按它合并各通道
+} HistoryRecord;
+
+// 一个通道的订阅者列表，第一次收到该通道的记录时按所有客户端的订阅计算；
+// 之后客户端连接、断开或修改订阅时只增删该客户端，其他通道的列表不受影响
+typedef struct RouteEntry {
+    uint64_t hash;
+    char network[9];
+    char station[9];
+    char location[9];
+    char channel[12];
+    int stale;                  // 增量更新时内存不足，下次使用时重新计算
+    ClientConnection** subscribers;
+    int count;
+    int capacity;
+    HistoryRecord* history;     // 最近数据环，按需扩容
+    uint32_t history_head;
+    uint32_t history_count;
+    uint32_t history_mask;
+    struct RouteEntry* next;
+} RouteEntry;
+
+// TCP转发服务器：一个epoll循环负责接受连接、发送数据和检测断开，不再每个客户端一个线程；
+// 客户端表按需扩容，没有连接数上限（受进程的文件描述符上限限制）。
+// 广播在转发线程中进行，每条记录从记录池取一个共享缓冲区复制一次，
+// 持锁期间只把记录指针放入各客户端的队列，不复制、不做系统调用；
+// 队列从空变为非空的客户端放入待发送列表，事件循环空闲时用eventfd唤醒一次。
+// 客户端socket为非阻塞，用边沿触发的EPOLLOUT在可写时继续发送。
+// 客户端可发送 SUBSCRIBE NET.STA.LOC.CHA... 只接收匹配的通道，路由按通道缓存订阅者列表，
+// 每条记录的开销与匹配的客户端数成正比。
+// 启用最近数据环时每个通道保留最近一段时间的记录（只是共享记录的引用），
+// 客户端发送 SINCE 时间 后先回放其中连接之前的记录，再接着实时数据
 typedef struct TCPServer {
     int server_fd;
+    int epoll_fd;
+    int wake_fd;                // eventfd，广播和server_stop用来唤醒事件循环
+    int spare_fd;               // 预留的描述符，fd用完时用来接受并立即关闭新连接
     struct sockaddr_in addr;
-    ClientConnection clients[MAX_CLIENTS];  // 现在可以使用 ClientConnection
+    ClientConnection** clients; // 动态数组，删除时用最后一个填补空位
     int client_count;
+    int client_capacity;
+    ClientConnection** ready;   // 待发送列表，容量与客户端表相同
+    ClientConnection** ready_work;  // 事件循环处理时与ready交换
+    int ready_count;
+    int wake_pending;           // 已写eventfd，事件循环尚未取走待发送列表
+    ClientConnection* dead;     // 已断开、等待释放的客户端
+    RecordPool* pool;           // 待发送记录的共享缓冲区
+    RouteEntry** routes;        // 通道到订阅者的路由表
+    size_t route_count;
+    uint64_t sequence;          // 已广播的记录数，作为记录序号
+    int64_t history_window;     // 最近数据环保留的时长（纳秒），0为不保留
+    ServerPolicy policy;
+    uint32_t queue_capacity;
+    int held_clients;           // 暂不发送、等待SINCE的客户端数，只由事件循环线程访问
+    volatile int running;
     pthread_mutex_t mutex;
+    
+    // 统计
+    uint64_t dropped;           // 所有客户端丢弃的记录数
+    uint64_t slow_disconnects;  // 因队列满而断开的客户端数
+    uint64_t route_rebuilds;    // 完整计算订阅者列表的次数
+    uint64_t replays;           // 执行SINCE的次数
+    uint64_t replayed;          // 回放的记录数
+    uint64_t replay_overlaps;   // 拼接回放时跳过的与回放重叠的实时记录数
 } TCPServer;
 
 // 函数声明
 TCPServer* server_create(int port);
+int server_parse_policy(const char* spec, ServerPolicy* policy, uint32_t* capacity);
+void server_set_client_policy(TCPServer* server, ServerPolicy policy, uint32_t capacity);
+void server_set_history(TCPServer* server, int seconds);
 int server_start(TCPServer* server);
 int server_broadcast_data(TCPServer* server, const unsigned char* data, size_t size);
+int server_broadcast_records(TCPServer* server, const QueueRecord* records, int count);
 void server_stop(TCPServer* server);
 void server_destroy(TCPServer* server);
 
-#endif 
\ No newline at end of file
+#endif
@@ -0,0 +1,157 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "uring.h"
+
+// 与内核共享的环形队列索引需要acquire/release语义
+#define ring_load_acquire(p) atomic_load_explicit((_Atomic unsigned*)(p), memory_order_acquire)
+#define ring_store_release(p, v) atomic_store_explicit((_Atomic unsigned*)(p), (v), memory_order_release)
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params* params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, const void* arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+// 创建io_uring并映射提交队列、完成队列和SQE数组，失败时返回-1并保留errno
+int uring_init(URing* ring, unsigned entries) {
+    struct io_uring_params params;
+    memset(ring, 0, sizeof(URing));
+    memset(&params, 0, sizeof(params));
+    
+    ring->fd = sys_io_uring_setup(entries, &params);
+    if (ring->fd < 0) return -1;
+    
+    ring->entries = params.sq_entries;
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_size > ring->sq_ring_size) ring->sq_ring_size = ring->cq_ring_size;
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+    
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) goto fail;
+    
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) goto fail;
+    }
+    
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) goto fail;
+    
+    char* sq = (char*)ring->sq_ring;
+    ring->sq_head = (unsigned*)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned*)(sq + params.sq_off.array);
+    ring->sqe_tail = ring->sqe_submitted = *ring->sq_tail;
+    
+    char* cq = (char*)ring->cq_ring;
+    ring->cq_head = (unsigned*)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    return 0;
+    
+fail:
+    {
+        int saved = errno;
+        uring_exit(ring);
+        errno = saved;
+    }
+    return -1;
+}
+
+void uring_exit(URing* ring) {
+    if (ring->sqes && ring->sqes != MAP_FAILED) munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring && ring->cq_ring != MAP_FAILED && ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    if (ring->sq_ring && ring->sq_ring != MAP_FAILED) munmap(ring->sq_ring, ring->sq_ring_size);
+    if (ring->fd >= 0) close(ring->fd);
+    memset(ring, 0, sizeof(URing));
+    ring->fd = -1;
+}
+
+// 取得一个空闲的SQE，提交队列已满时返回NULL
+struct io_uring_sqe* uring_get_sqe(URing* ring) {
+    unsigned head = ring_load_acquire(ring->sq_head);
+    if (ring->sqe_tail - head >= ring->entries) return NULL;
+    
+    unsigned index = ring->sqe_tail & *ring->sq_mask;
+    struct io_uring_sqe* sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+    ring->sqe_tail++;
+    return sqe;
+}
+
+// 提交所有已填写的SQE，并等待至少wait_nr个完成事件；一次系统调用
+int uring_submit(URing* ring, unsigned wait_nr) {
+    unsigned to_submit = ring->sqe_tail - ring->sqe_submitted;
+    if (to_submit == 0 && wait_nr == 0) return 0;
+    
+    ring_store_release(ring->sq_tail, ring->sqe_tail);
+    while (1) {
+        int rc = sys_io_uring_enter(ring->fd, to_submit, wait_nr,
+                                    wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0);
+        if (rc < 0 && errno == EINTR) continue;
+        if (rc >= 0) ring->sqe_submitted += rc;
+        return rc;
+    }
+}
+
+// 处理所有已完成的事件，返回处理的个数
+unsigned uring_reap(URing* ring, URingCompletionHandler handler, void* user) {
+    unsigned head = *ring->cq_head;
+    unsigned tail = ring_load_acquire(ring->cq_tail);
+    unsigned count = 0;
+    
+    while (head != tail) {
+        handler(&ring->cqes[head & *ring->cq_mask], user);
+        head++;
+        count++;
+    }
+    ring_store_release(ring->cq_head, head);
+    return count;
+}
+
+// 注册固定缓冲区，之后可用IORING_OP_WRITE_FIXED免去每次的页面映射
+int uring_register_buffers(URing* ring, const struct iovec* iovecs, unsigned count) {
+    return sys_io_uring_register(ring->fd, IORING_REGISTER_BUFFERS, iovecs, count);
+}
+
+// 查询内核是否支持某个操作码；不支持IORING_REGISTER_PROBE的内核（5.6以前）
+// 也没有IORING_OP_WRITE，按不支持处理
+int uring_supports_op(URing* ring, unsigned op) {
+    const unsigned ops_len = 256;
+    struct io_uring_probe* probe = (struct io_uring_probe*)calloc(1,
+        sizeof(struct io_uring_probe) + ops_len * sizeof(struct io_uring_probe_op));
+    if (!probe) return 0;
+    
+    int supported = 0;
+    if (sys_io_uring_register(ring->fd, IORING_REGISTER_PROBE, probe, ops_len) == 0 &&
+        op <= probe->last_op && op < probe->ops_len) {
+        supported = (probe->ops[op].flags & IO_URING_OP_SUPPORTED) != 0;
+    }
+    free(probe);
+    return supported;
+}
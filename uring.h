@@ -0,0 +1,48 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+// 最小的io_uring封装，直接使用系统调用，不依赖liburing
+// 只供单个线程使用：提交队列和完成队列都由调用线程访问
+typedef struct {
+    int fd;
+    unsigned entries;
+    
+    // 提交队列
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    struct io_uring_sqe* sqes;
+    unsigned sqe_tail;          // 已填写但尚未提交的位置
+    unsigned sqe_submitted;     // 已告知内核的位置
+    
+    // 完成队列
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+    
+    void* sq_ring;
+    size_t sq_ring_size;
+    void* cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+} URing;
+
+// 完成事件处理函数
+typedef void (*URingCompletionHandler)(const struct io_uring_cqe* cqe, void* user);
+
+// 函数声明
+int uring_init(URing* ring, unsigned entries);
+void uring_exit(URing* ring);
+struct io_uring_sqe* uring_get_sqe(URing* ring);
+int uring_submit(URing* ring, unsigned wait_nr);
+unsigned uring_reap(URing* ring, URingCompletionHandler handler, void* user);
+int uring_register_buffers(URing* ring, const struct iovec* iovecs, unsigned count);
+int uring_supports_op(URing* ring, unsigned op);
+
+#endif